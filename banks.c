@@ -0,0 +1,56 @@
+#include "banks.h"
+
+static void writeBankWindow(CPU *cpu, int address, unsigned char value, void *context) {
+	BankWindow *window = context;
+	int page = address >> 0x8;
+	
+	if(address == window->registerAddress) {
+		switchBank(cpu, window, value);
+	} else if(!window->readOnly || page < window->firstPage || page >= window->firstPage + window->pageCount) {
+		*memoryByte(cpu, address) = value;
+	}
+}
+
+void initializeBankWindow(BankWindow *window, unsigned char *data, int bankCount, int firstPage, int pageCount) {
+	window->data = data;
+	window->bankCount = bankCount;
+	window->firstPage = firstPage;
+	window->pageCount = pageCount;
+	window->currentBank = 0;
+	window->registerAddress = -1;
+	window->readOnly = 0;
+	window->hook.read = NULL;
+	window->hook.write = writeBankWindow;
+	window->hook.context = window;
+}
+
+void setBankRegister(BankWindow *window, int address) {
+	window->registerAddress = address;
+}
+
+void attachBankWindow(CPU *cpu, BankWindow *window) {
+	int i;
+	if(window->readOnly) {
+		for(i = 0; i < window->pageCount; i++) {
+			cpu->hooks[window->firstPage + i] = &window->hook;
+		}
+	}
+	if(window->registerAddress >= 0) {
+		cpu->hooks[window->registerAddress >> 0x8] = &window->hook;
+	}
+	switchBank(cpu, window, window->currentBank);
+}
+
+void switchBank(CPU *cpu, BankWindow *window, int bank) {
+	int i;
+	unsigned char *base;
+	
+	bank = ((bank % window->bankCount) + window->bankCount) % window->bankCount; // a negative bank counts back from the last
+	base = window->data + (bank * window->pageCount * PAGE_SIZE);
+	for(i = 0; i < window->pageCount; i++) {
+		cpu->memory[window->firstPage + i] = base + (i * PAGE_SIZE);
+	}
+	cpu->zeroPage = cpu->memory[0];
+	cpu->stackPage = cpu->memory[1];
+	window->currentBank = bank;
+}
@@ -0,0 +1,39 @@
+#ifndef BANKS_H
+#define BANKS_H
+
+#include "cpu.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A run of pages in the 64 KiB address space that shows one bank at a time out of a larger host buffer.
+// Switching rewrites the window's page table entries only (pageCount pointers), nothing is copied.
+// Code that caches anything per address (decoded blocks...) should key it on the page's host pointer
+// (cpu->memory[page]) rather than on the guest address, so each bank keeps its own entries across switches.
+// A window over pages 0 or 1 switches like any other, but can't be read-only or hold its register there (cpu.h).
+typedef struct {
+	unsigned char *data; // bankCount banks of pageCount * PAGE_SIZE bytes each, owned by the host
+	int bankCount;
+	int firstPage;
+	int pageCount;
+	int currentBank;
+	
+	int registerAddress; // guest writes here select bank (value % bankCount), -1 to switch from the host only
+	int readOnly; // guest writes into the window are dropped (ROM banks)
+	MemoryHook hook;
+} BankWindow;
+
+void initializeBankWindow(BankWindow *window, unsigned char *data, int bankCount, int firstPage, int pageCount);
+void setBankRegister(BankWindow *window, int address); // call before attachBankWindow, -1 for none
+// maps the current bank into cpu and installs the hooks for the register and read-only pages,
+// replacing any other hook on those pages; initializeMemory (and resetPooledCPU) detach every window
+void attachBankWindow(CPU *cpu, BankWindow *window);
+// bank is taken modulo bankCount, negative ones counting back from the last (-1 is bankCount - 1)
+void switchBank(CPU *cpu, BankWindow *window, int bank);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,317 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "cpu.h"
+#include "memory.h"
+
+// Dispatch speed of the interpreter on small guest workloads: ./6502_bench [million cycles]
+// One workload per instruction class (loads and stores, ALU, read-modify-write, branches, stack) shows which part of
+// the core a change speeds up or slows down; calls and pairs mix them like guest code does.
+// Each workload is loaded at $0600, runs step() until the cycle budget is spent and reports emulated MHz, then runs
+// again with the fused step function (instruction pairs from one dispatch, see stepFusedNMOS in cpu.h) and checks
+// that both runs end in the same state.
+// The churn rounds then create a CPU, run the memory workload on it, reset it, run it again and destroy it, with
+// initializeCPU and freeCPU and with a MemoryPool in each reset mode, and report CPUs per second. make ASAN=1 bench
+// runs them with AddressSanitizer, which fails the run if anything they allocate leaks.
+
+#define BENCH_CYCLES 200 // million, per workload
+#define BENCH_ORIGIN 0x0600
+#define CHURN_ROUNDS 100000
+#define CHURN_LIVE 16 // CPUs alive at once, each round destroys the oldest
+#define CHURN_CYCLES 500 // per run, twice a round
+
+typedef struct {
+	const char *name;
+	const unsigned char *code;
+	int length;
+} Workload;
+
+// loads and stores through most addressing modes
+static const unsigned char memory[] = {
+	0xA2, 0x00, // $0600 LDX #$00
+	0xA5, 0x10, // $0602 loop: LDA $10
+	0x9D, 0x00, 0x03, // STA $0300,X
+	0xA4, 0x11, // LDY $11
+	0x95, 0x20, // STA $20,X
+	0xB1, 0x30, // LDA ($30),Y
+	0x99, 0x00, 0x05, // STA $0500,Y
+	0xBD, 0x00, 0x03, // LDA $0300,X
+	0x86, 0x12, // STX $12
+	0xE8, // INX
+	0x4C, 0x02, 0x06, // JMP loop
+};
+
+// arithmetic, logic and compares on the accumulator
+static const unsigned char alu[] = {
+	0xA5, 0x10, // $0600 loop: LDA $10
+	0x18, // CLC
+	0x69, 0x03, // ADC #$03
+	0x29, 0x7F, // AND #$7F
+	0x05, 0x11, // ORA $11
+	0x49, 0x55, // EOR #$55
+	0x38, // SEC
+	0xE5, 0x12, // SBC $12
+	0xC9, 0x40, // CMP #$40
+	0xE4, 0x13, // CPX $13
+	0x65, 0x14, // ADC $14
+	0x85, 0x10, // STA $10
+	0xE8, // INX
+	0x4C, 0x00, 0x06, // JMP loop
+};
+
+// read-modify-write on zero page, absolute and indexed memory, and on the accumulator
+static const unsigned char modify[] = {
+	0xA2, 0x00, // $0600 LDX #$00
+	0xE6, 0x10, // $0602 loop: INC $10
+	0x06, 0x11, // ASL $11
+	0x2E, 0x00, 0x03, // ROL $0300
+	0x56, 0x12, // LSR $12,X
+	0x7E, 0x01, 0x03, // ROR $0301,X
+	0xCE, 0x02, 0x03, // DEC $0302
+	0x0A, // ASL A
+	0xE8, // INX
+	0x4C, 0x02, 0x06, // JMP loop
+};
+
+// conditional branches taken and not taken, forwards and backwards
+static const unsigned char branches[] = {
+	0xA2, 0x00, // $0600 loop: LDX #$00
+	0x8A, // $0602 inner: TXA
+	0x29, 0x03, // AND #$03
+	0xF0, 0x02, // BEQ skip
+	0xA0, 0x01, // LDY #$01
+	0xC9, 0x02, // $0609 skip: CMP #$02
+	0x90, 0x01, // BCC low
+	0xC8, // INY
+	0x24, 0x10, // $060E low: BIT $10
+	0x10, 0x00, // BPL plus
+	0x70, 0x00, // $0612 plus: BVS next
+	0xE8, // $0614 next: INX
+	0xD0, 0xEB, // BNE inner
+	0x4C, 0x00, 0x06, // JMP loop
+};
+
+// pushes and pulls of A and P, TSX, and a JSR to a leaf routine
+static const unsigned char stack[] = {
+	0xA9, 0x11, // $0600 loop: LDA #$11
+	0x48, // PHA
+	0x08, // PHP
+	0x8A, // TXA
+	0x48, // PHA
+	0xBA, // TSX
+	0x68, // PLA
+	0x28, // PLP
+	0x68, // PLA
+	0x20, 0x10, 0x06, // JSR leaf
+	0x4C, 0x00, 0x06, // JMP loop
+	0x48, // $0610 leaf: PHA
+	0x68, // PLA
+	0x60, // RTS
+};
+
+// JSR three levels deep, every level saving something on the stack and working on zero page
+static const unsigned char calls[] = {
+	0xA2, 0x00, // $0600 LDX #$00
+	0x20, 0x10, 0x06, // $0602 loop: JSR first
+	0x4C, 0x02, 0x06, // $0605 JMP loop
+	0xEA, 0xEA, 0xEA, 0xEA, 0xEA, 0xEA, 0xEA, 0xEA,
+	0x48, // $0610 first: PHA
+	0xA5, 0x10, // LDA $10
+	0x69, 0x01, // ADC #$01
+	0x85, 0x10, // STA $10
+	0x20, 0x20, 0x06, // JSR second
+	0x68, // PLA
+	0x60, // RTS
+	0xEA, 0xEA, 0xEA, 0xEA,
+	0x08, // $0620 second: PHP
+	0xE6, 0x11, // INC $11
+	0xB4, 0x12, // LDY $12,X
+	0x84, 0x13, // STY $13
+	0x20, 0x30, 0x06, // JSR third
+	0x28, // PLP
+	0x60, // RTS
+	0xEA, 0xEA, 0xEA, 0xEA,
+	0x8A, // $0630 third: TXA
+	0x48, // PHA
+	0xA5, 0x14, // LDA $14
+	0x55, 0x15, // EOR $15,X
+	0x85, 0x14, // STA $14
+	0x68, // PLA
+	0xAA, // TAX
+	0x60, // RTS
+};
+
+// the pairs stepFusedNMOS runs from one dispatch: LDA/STA, CLC/ADC, CMP #imm/BNE, DEX/BNE, DEY/BNE
+static const unsigned char pairs[] = {
+	0xA2, 0x10, // $0600 loop: LDX #$10
+	0xA9, 0x01, // $0602 inner: LDA #$01
+	0x85, 0x20, // STA $20
+	0x18, // CLC
+	0x69, 0x02, // ADC #$02
+	0x85, 0x21, // STA $21
+	0xA5, 0x20, // LDA $20
+	0x8D, 0x00, 0x03, // STA $0300
+	0xC9, 0x03, // CMP #$03
+	0xD0, 0x00, // BNE next
+	0xCA, // $0614 next: DEX
+	0xD0, 0xEB, // BNE inner
+	0xA0, 0x08, // LDY #$08
+	0x88, // $0619 wait: DEY
+	0xD0, 0xFD, // BNE wait
+	0x4C, 0x00, 0x06, // JMP loop
+};
+
+static const Workload workloads[] = {
+	{ "memory", memory, sizeof(memory) },
+	{ "alu", alu, sizeof(alu) },
+	{ "modify", modify, sizeof(modify) },
+	{ "branches", branches, sizeof(branches) },
+	{ "stack", stack, sizeof(stack) },
+	{ "calls", calls, sizeof(calls) },
+	{ "pairs", pairs, sizeof(pairs) },
+};
+
+typedef struct {
+	const char *name;
+	int pooled;
+	int resetMode;
+	int baseline; // the workload comes from the pool's baseline instead of being written into every CPU
+} Churn;
+
+static const Churn churns[] = {
+	{ "initializeCPU", 0, MEMORY_RESET_CLEAR, 0 },
+	{ "pool clear", 1, MEMORY_RESET_CLEAR, 0 },
+	{ "pool remap", 1, MEMORY_RESET_REMAP, 0 },
+	{ "pool remap baseline", 1, MEMORY_RESET_REMAP, 1 },
+};
+
+static double seconds(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static int sameState(CPU *first, CPU *second) {
+	return first->cycles == second->cycles && first->pc == second->pc && first->sp == second->sp && first->a == second->a &&
+		first->x == second->x && first->y == second->y && first->ps == second->ps && first->pageCrossings == second->pageCrossings &&
+		memcmp(first->ram, second->ram, MEMORY_SIZE) == 0;
+}
+
+static void runChurned(CPU *cpu, int load) {
+	if(load) {
+		writeMemory(cpu, (char *)memory, BENCH_ORIGIN, sizeof(memory));
+	}
+	cpu->pc = BENCH_ORIGIN;
+	while(cpu->cycles < CHURN_CYCLES) {
+		step(cpu);
+	}
+}
+
+// CPUs created, run, reset, run again and destroyed per second, -1 if the pool can't be set up
+static double churnRate(const Churn *churn) {
+	static unsigned char baseline[MEMORY_SIZE];
+	MemoryPool pool;
+	CPU locals[CHURN_LIVE];
+	CPU *live[CHURN_LIVE] = { NULL };
+	int i;
+
+	if(churn->pooled) {
+		if(initializeMemoryPool(&pool, CHURN_LIVE) != 0) {
+			return -1;
+		}
+		setMemoryPoolResetMode(&pool, churn->resetMode);
+		memcpy(baseline + BENCH_ORIGIN, memory, sizeof(memory));
+		if(churn->baseline && setMemoryPoolBaseline(&pool, baseline) != 0) {
+			freeMemoryPool(&pool);
+			return -1;
+		}
+	}
+
+	double start = seconds();
+	for(i = 0; i < CHURN_ROUNDS + CHURN_LIVE; i++) {
+		int slot = i % CHURN_LIVE;
+		CPU *cpu = live[slot];
+		if(cpu != NULL) {
+			if(churn->pooled) {
+				releaseCPU(&pool, cpu);
+			} else {
+				freeCPU(cpu);
+			}
+			live[slot] = NULL;
+		}
+		if(i >= CHURN_ROUNDS) {
+			continue; // destroys the last ones
+		}
+
+		if(churn->pooled) {
+			cpu = allocateCPU(&pool);
+		} else {
+			cpu = &locals[slot];
+			initializeCPU(cpu);
+		}
+		runChurned(cpu, !churn->baseline);
+		if(churn->pooled) {
+			resetPooledCPU(&pool, cpu);
+		} else {
+			memset(cpu->ram, 0, MEMORY_SIZE);
+			resetCPU(cpu);
+		}
+		runChurned(cpu, !churn->baseline);
+		live[slot] = cpu;
+	}
+	double elapsed = seconds() - start;
+
+	if(churn->pooled) {
+		freeMemoryPool(&pool);
+	}
+	return CHURN_ROUNDS / elapsed;
+}
+
+int main(int argc, char *argv[]) {
+	long budget = (argc > 1 ? atol(argv[1]) : BENCH_CYCLES) * 1000000;
+	int result = 0;
+	int i;
+
+	for(i = 0; i < (int)(sizeof(workloads) / sizeof(workloads[0])); i++) {
+		CPU cpu, fused;
+		int pc;
+		initializeCPU(&cpu);
+		writeMemory(&cpu, (char *)workloads[i].code, BENCH_ORIGIN, workloads[i].length);
+		cpu.pc = BENCH_ORIGIN;
+		initializeCPU(&fused);
+		writeMemory(&fused, (char *)workloads[i].code, BENCH_ORIGIN, workloads[i].length);
+		fused.pc = BENCH_ORIGIN;
+
+		double start = seconds();
+		while(cpu.cycles < budget) {
+			step(&cpu);
+		}
+		double elapsed = seconds() - start;
+
+		start = seconds();
+		while(fused.cycles < budget) {
+			stepFusedNMOS(&fused, budget, &pc);
+		}
+		double fused_elapsed = seconds() - start;
+
+		printf("BENCH %s: %.1f MHz, fused %.1f MHz\n", workloads[i].name, cpu.cycles / elapsed / 1e6, fused.cycles / fused_elapsed / 1e6);
+		if(!sameState(&cpu, &fused)) {
+			printf("BENCH %s: the fused run ended in another state.\n", workloads[i].name);
+			result = -1;
+		}
+		freeCPU(&cpu);
+		freeCPU(&fused);
+	}
+
+	for(i = 0; i < (int)(sizeof(churns) / sizeof(churns[0])); i++) {
+		double rate = churnRate(&churns[i]);
+		if(rate < 0) {
+			printf("BENCH churn %s: can't set up the pool.\n", churns[i].name);
+			result = -1;
+			continue;
+		}
+		printf("BENCH churn %s: %.0f CPUs/s\n", churns[i].name, rate);
+	}
+
+	return result;
+}
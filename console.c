@@ -0,0 +1,201 @@
+#include <stdatomic.h>
+#include <pthread.h>
+#include <poll.h>
+#include <unistd.h>
+#include "console.h"
+
+#define CONSOLE_QUEUE_SIZE 4096 // power of two
+#define CONSOLE_IDLE_WAIT 1 // ms the host thread sleeps when there is nothing to do
+
+// head and tail only ever grow (wrapping), each written by one side only
+typedef struct {
+	_Atomic unsigned int head; // next byte to take, written by the consumer
+	_Atomic unsigned int tail; // next free slot, written by the producer
+	unsigned char data[CONSOLE_QUEUE_SIZE];
+} ByteQueue;
+
+struct ConsoleDevice {
+	int address;
+	MemoryHook hook;
+	ByteQueue output;
+	ByteQueue input;
+	_Atomic long droppedOutput;
+	
+	pthread_t thread;
+	int threadRunning;
+	_Atomic int stopThread;
+	int outputFile;
+	int inputFile;
+};
+
+static int queuePut(ByteQueue *queue, const unsigned char *buffer, int length) {
+	unsigned int tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+	unsigned int head = atomic_load_explicit(&queue->head, memory_order_acquire);
+	int room = CONSOLE_QUEUE_SIZE - (int)(tail - head);
+	int i;
+	
+	if(length > room) {
+		length = room;
+	}
+	for(i = 0; i < length; i++) {
+		queue->data[(tail + i) & (CONSOLE_QUEUE_SIZE - 1)] = buffer[i];
+	}
+	atomic_store_explicit(&queue->tail, tail + length, memory_order_release);
+	return length;
+}
+
+static int queueTake(ByteQueue *queue, unsigned char *buffer, int length) {
+	unsigned int head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+	unsigned int tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+	int available = (int)(tail - head);
+	int i;
+	
+	if(length > available) {
+		length = available;
+	}
+	for(i = 0; i < length; i++) {
+		buffer[i] = queue->data[(head + i) & (CONSOLE_QUEUE_SIZE - 1)];
+	}
+	atomic_store_explicit(&queue->head, head + length, memory_order_release);
+	return length;
+}
+
+static int queueCount(ByteQueue *queue) {
+	return (int)(atomic_load_explicit(&queue->tail, memory_order_acquire) - atomic_load_explicit(&queue->head, memory_order_acquire));
+}
+
+static unsigned char readConsole(CPU *cpu, int address, void *context) {
+	ConsoleDevice *console = context;
+	unsigned char value = 0;
+	
+	if(address == console->address) {
+		queueTake(&console->input, &value, 1);
+		return value;
+	}
+	if(address == console->address + 1) {
+		return (queueCount(&console->input) > 0 ? CONSOLE_INPUT_READY : 0) | (queueCount(&console->output) < CONSOLE_QUEUE_SIZE ? CONSOLE_OUTPUT_READY : 0);
+	}
+	return *memoryByte(cpu, address);
+}
+
+static void writeConsole(CPU *cpu, int address, unsigned char value, void *context) {
+	ConsoleDevice *console = context;
+	
+	if(address == console->address) {
+		if(queuePut(&console->output, &value, 1) == 0) {
+			atomic_fetch_add_explicit(&console->droppedOutput, 1, memory_order_relaxed);
+		}
+	} else if(address != console->address + 1) {
+		*memoryByte(cpu, address) = value;
+	}
+}
+
+ConsoleDevice *createConsoleDevice(int address) {
+	if(address < 0x200 || address > 0xFFFF || (address & 0xFF) == 0xFF) {
+		return NULL; // the core ignores hooks on pages 0 and 1, and STATUS has to be on the same page
+	}
+	
+	ConsoleDevice *console = calloc(1, sizeof(ConsoleDevice));
+	if(console == NULL) {
+		return NULL;
+	}
+	
+	console->address = address;
+	console->hook.read = readConsole;
+	console->hook.write = writeConsole;
+	console->hook.context = console;
+	console->outputFile = -1;
+	console->inputFile = -1;
+	return console;
+}
+
+void freeConsoleDevice(ConsoleDevice *console) {
+	if(console == NULL) {
+		return;
+	}
+	
+	stopConsoleThread(console);
+	free(console);
+}
+
+void attachConsoleDevice(CPU *cpu, ConsoleDevice *console) {
+	cpu->hooks[console->address >> 0x8] = &console->hook;
+}
+
+int consoleTakeOutput(ConsoleDevice *console, unsigned char *buffer, int length) {
+	return queueTake(&console->output, buffer, length);
+}
+
+int consolePutInput(ConsoleDevice *console, const unsigned char *buffer, int length) {
+	return queuePut(&console->input, buffer, length);
+}
+
+long consoleDroppedOutput(ConsoleDevice *console) {
+	return atomic_load_explicit(&console->droppedOutput, memory_order_relaxed);
+}
+
+// moves bytes between the queues and the files until stopped, writing out whatever is left at the end
+static void *runConsoleThread(void *context) {
+	ConsoleDevice *console = context;
+	unsigned char buffer[CONSOLE_QUEUE_SIZE];
+	int stopping = 0;
+	
+	while(!stopping) {
+		stopping = atomic_load_explicit(&console->stopThread, memory_order_acquire);
+		int moved = 0;
+		
+		if(console->outputFile >= 0) {
+			int length = queueTake(&console->output, buffer, sizeof(buffer));
+			int written = 0;
+			while(written < length) {
+				ssize_t result = write(console->outputFile, buffer + written, length - written);
+				if(result <= 0) {
+					break; // file closed, the rest is lost
+				}
+				written += result;
+			}
+			moved += length;
+		}
+		
+		struct pollfd input = { console->inputFile, POLLIN, 0 };
+		int room = CONSOLE_QUEUE_SIZE - queueCount(&console->input);
+		if(console->inputFile >= 0 && room > 0 && poll(&input, 1, (moved || stopping) ? 0 : CONSOLE_IDLE_WAIT) > 0) {
+			ssize_t length = read(console->inputFile, buffer, room);
+			if(length > 0) {
+				consolePutInput(console, buffer, length);
+				moved += length;
+			} else {
+				console->inputFile = -1; // end of input
+			}
+		} else if(!moved && !stopping) {
+			usleep(CONSOLE_IDLE_WAIT * 1000);
+		}
+	}
+	
+	return NULL;
+}
+
+int startConsoleThread(ConsoleDevice *console, int output_fd, int input_fd) {
+	if(console->threadRunning) {
+		return -1;
+	}
+	
+	console->outputFile = output_fd;
+	console->inputFile = input_fd;
+	atomic_store(&console->stopThread, 0);
+	if(pthread_create(&console->thread, NULL, runConsoleThread, console) != 0) {
+		return -1;
+	}
+	console->threadRunning = 1;
+	return 0;
+}
+
+void stopConsoleThread(ConsoleDevice *console) {
+	if(!console->threadRunning) {
+		return;
+	}
+	
+	atomic_store_explicit(&console->stopThread, 1, memory_order_release);
+	pthread_join(console->thread, NULL);
+	console->threadRunning = 0;
+}
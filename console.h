@@ -0,0 +1,43 @@
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include "cpu.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Memory-mapped character device. The guest sees two registers:
+//   address     DATA   write: queue an output byte; read: next input byte (0 when there is none)
+//   address+1   STATUS bit 0: input waiting, bit 1: room for output (a write with no room is dropped)
+// Output and input go through lock-free single producer/single consumer queues, so the emulation
+// thread never makes a syscall: the host drains output and feeds input from another thread, either its own
+// (consoleTakeOutput/consolePutInput) or the one startConsoleThread runs between the queues and file descriptors.
+// Reads of DATA have a side effect, so CYCLE_EXACT dummy reads of it take a byte too, as on the real bus.
+
+#define CONSOLE_INPUT_READY 0x1
+#define CONSOLE_OUTPUT_READY 0x2
+
+typedef struct ConsoleDevice ConsoleDevice;
+
+// address has to be on page 2 or above (the core ignores hooks on pages 0 and 1) and not end a page, so both registers
+// are on the page attachConsoleDevice hooks; NULL for any other address or if it can't allocate
+ConsoleDevice *createConsoleDevice(int address);
+void freeConsoleDevice(ConsoleDevice *console); // stops its thread first
+// hooks the page holding the registers (replacing any other hook there); the rest of that page stays memory
+void attachConsoleDevice(CPU *cpu, ConsoleDevice *console);
+
+// host side, from one thread at a time (the consumer of output, the producer of input)
+int consoleTakeOutput(ConsoleDevice *console, unsigned char *buffer, int length); // returns the bytes taken
+int consolePutInput(ConsoleDevice *console, const unsigned char *buffer, int length); // returns the bytes queued
+long consoleDroppedOutput(ConsoleDevice *console);
+
+// thread that writes output to output_fd and queues what arrives on input_fd (-1 for none); returns -1 on failure
+int startConsoleThread(ConsoleDevice *console, int output_fd, int input_fd);
+void stopConsoleThread(ConsoleDevice *console);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,822 @@
+#ifndef CORE_H
+#define CORE_H
+
+#include "cpu.h"
+#include "flags.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The instruction set, all inline: memory accessors, addressing modes, operations and instruction shapes.
+// Only for the core itself (cpu.c) and for C recompiled from a guest image (see recompile.c), which runs the
+// same statements as step() without fetching and dispatching opcodes.
+
+
+#ifdef CYCLE_EXACT
+#define addCycles(cpu, count) // every bus access below is one cycle, so instructions don't add cycles in bulk
+#else
+#define addCycles(cpu, count) ((cpu)->cycles += (count))
+#endif
+
+#ifdef CYCLE_EXACT
+static inline void busCycle(CPU *cpu, int address, unsigned char value, int type) {
+	if(cpu->busCallback != NULL) {
+		cpu->busCallback(cpu, address, value, type);
+	}
+	cpu->cycles++;
+}
+#endif
+
+static inline void logWrite(CPU *cpu, int address, unsigned char value) {
+	WriteLog *log = cpu->writeLog;
+	if(log->count < WRITE_LOG_SIZE) {
+		log->addresses[log->count] = address;
+		log->values[log->count++] = value;
+	}
+}
+
+#ifdef HEATMAP
+static inline void countAccess(CPU *cpu, int address, int kind) {
+	if(cpu->heatmap != NULL) {
+		cpu->heatmap->counts[kind][address]++;
+	}
+}
+#else
+#define countAccess(cpu, address, kind)
+#endif
+
+#ifdef COVERAGE
+static inline void markCoverage(unsigned char *bitmap, int address) {
+	bitmap[address >> 0x3] |= 1 << (address & 0x7);
+}
+
+// before the opcode fetch, pc is the instruction's address
+static inline void coverInstruction(CPU *cpu) {
+	if(cpu->coverage != NULL) {
+		markCoverage(cpu->coverage->executed, cpu->pc);
+	}
+}
+
+static inline void coverBranch(CPU *cpu, int address, int taken) {
+	if(cpu->coverage != NULL) {
+		markCoverage(taken ? cpu->coverage->taken : cpu->coverage->notTaken, address);
+	}
+}
+#else
+#define coverInstruction(cpu)
+#define coverBranch(cpu, address, taken)
+#endif
+
+// a bus read the heatmap doesn't count as a data read: fetches and dummy reads
+static inline unsigned char readBus(CPU *cpu, int address) {
+	MemoryHook *hook = cpu->hooks[address >> 0x8];
+	unsigned char value = (hook != NULL && hook->read != NULL ? hook->read(cpu, address, hook->context) : *memoryByte(cpu, address));
+#ifdef CYCLE_EXACT
+	busCycle(cpu, address, value, BUS_READ);
+#endif
+	return value;
+}
+
+static inline unsigned char readByte(CPU *cpu, int address) {
+	countAccess(cpu, address, HEATMAP_READ);
+	return readBus(cpu, address);
+}
+
+// the program byte at pc (opcode or operand), advancing pc past it
+static inline unsigned char fetchByte(CPU *cpu) {
+	countAccess(cpu, cpu->pc, HEATMAP_FETCH);
+	return readBus(cpu, cpu->pc++);
+}
+
+static inline void writeByte(CPU *cpu, int address, unsigned char value) {
+	countAccess(cpu, address, HEATMAP_WRITE);
+	MemoryHook *hook = cpu->hooks[address >> 0x8];
+	if(hook != NULL && hook->write != NULL) {
+		hook->write(cpu, address, value, hook->context);
+	} else {
+		*memoryByte(cpu, address) = value;
+	}
+	if(cpu->writeLog != NULL) {
+		logWrite(cpu, address, value);
+	}
+#ifdef CYCLE_EXACT
+	busCycle(cpu, address, value, BUS_WRITE);
+#endif
+}
+
+// Zero page and stack accesses: those pages have no hooks (cpu.h), so they skip the hook table and the page table.
+static inline unsigned char readZeroPage(CPU *cpu, unsigned char address) {
+	countAccess(cpu, address, HEATMAP_READ);
+	unsigned char value = cpu->zeroPage[address];
+#ifdef CYCLE_EXACT
+	busCycle(cpu, address, value, BUS_READ);
+#endif
+	return value;
+}
+
+static inline void writeZeroPage(CPU *cpu, unsigned char address, unsigned char value) {
+	countAccess(cpu, address, HEATMAP_WRITE);
+	cpu->zeroPage[address] = value;
+	if(cpu->writeLog != NULL) {
+		logWrite(cpu, address, value);
+	}
+#ifdef CYCLE_EXACT
+	busCycle(cpu, address, value, BUS_WRITE);
+#endif
+}
+
+static inline unsigned char readStack(CPU *cpu, unsigned char offset) {
+	countAccess(cpu, 0x100 + offset, HEATMAP_READ);
+	unsigned char value = cpu->stackPage[offset];
+#ifdef CYCLE_EXACT
+	busCycle(cpu, 0x100 + offset, value, BUS_READ);
+#endif
+	return value;
+}
+
+static inline void writeStack(CPU *cpu, unsigned char offset, unsigned char value) {
+	countAccess(cpu, 0x100 + offset, HEATMAP_WRITE);
+	cpu->stackPage[offset] = value;
+	if(cpu->writeLog != NULL) {
+		logWrite(cpu, 0x100 + offset, value);
+	}
+#ifdef CYCLE_EXACT
+	busCycle(cpu, 0x100 + offset, value, BUS_WRITE);
+#endif
+}
+
+// where each addressing mode's operand is, so the instruction shapes use the zero page accessors on page 0
+// and count immediate operands as fetches
+#define OPERAND_MEMORY 0
+#define OPERAND_ZERO_PAGE 1
+#define OPERAND_PROGRAM 2
+#define OPERAND_Immediate OPERAND_PROGRAM
+#define OPERAND_ZeroPage OPERAND_ZERO_PAGE
+#define OPERAND_ZeroPageX OPERAND_ZERO_PAGE
+#define OPERAND_ZeroPageY OPERAND_ZERO_PAGE
+#define OPERAND_Absolute OPERAND_MEMORY
+#define OPERAND_AbsoluteX OPERAND_MEMORY
+#define OPERAND_AbsoluteY OPERAND_MEMORY
+#define OPERAND_IndexedIndirect OPERAND_MEMORY
+#define OPERAND_IndirectIndexed OPERAND_MEMORY
+#define OPERAND_ZeroPageIndirect OPERAND_MEMORY
+
+// source is a constant at every call site
+static inline unsigned char readOperand(CPU *cpu, int address, int source) {
+	if(source == OPERAND_PROGRAM) {
+		countAccess(cpu, address, HEATMAP_FETCH);
+		return readBus(cpu, address);
+	}
+	return source == OPERAND_ZERO_PAGE ? readZeroPage(cpu, address) : readByte(cpu, address);
+}
+
+static inline void writeOperand(CPU *cpu, int address, unsigned char value, int source) {
+	if(source == OPERAND_ZERO_PAGE) {
+		writeZeroPage(cpu, address, value);
+	} else {
+		writeByte(cpu, address, value);
+	}
+}
+
+// Accesses the NMOS bus does while the instruction is busy internally, only made when built with CYCLE_EXACT: their
+// results are discarded, but hooks (a device register read twice, or written with its old value first) and the bus
+// callback still see them. The heatmap and write log don't.
+static inline void dummyRead(CPU *cpu, int address) {
+#ifdef CYCLE_EXACT
+	readBus(cpu, address);
+#endif
+}
+
+static inline void dummyWrite(CPU *cpu, int address, unsigned char value) {
+#ifdef CYCLE_EXACT
+	MemoryHook *hook = cpu->hooks[address >> 0x8];
+	if(hook != NULL && hook->write != NULL) {
+		hook->write(cpu, address, value, hook->context); // memory already holds value
+	}
+	busCycle(cpu, address, value, BUS_WRITE);
+#endif
+}
+
+static inline void dummyReadZeroPage(CPU *cpu, unsigned char address) {
+#ifdef CYCLE_EXACT
+	busCycle(cpu, address, cpu->zeroPage[address], BUS_READ);
+#endif
+}
+
+static inline void dummyReadStack(CPU *cpu) {
+#ifdef CYCLE_EXACT
+	busCycle(cpu, 0x100 + cpu->sp, cpu->stackPage[cpu->sp], BUS_READ);
+#endif
+}
+
+static inline void pushByteToStack(CPU *cpu, unsigned char byte) {
+	writeStack(cpu, cpu->sp, byte);
+	cpu->sp--;
+}
+
+static inline unsigned char pullByteFromStack(CPU *cpu) {
+	cpu->sp++;
+	return readStack(cpu, cpu->sp);
+}
+
+static inline void updateZeroAndNegativeFlags(CPU *cpu, unsigned char operation_result) { // operation_result can be accumulator, X, Y or any result
+	cpu->ps = (cpu->ps & 0x7D) | nzFlags[operation_result];
+}
+
+static inline void updateZeroNegativeAndCarryFlags(CPU *cpu, int operation_result) { // bit 8 of operation_result is the carry
+	cpu->ps = (cpu->ps & 0x7C) | nzcFlags[operation_result];
+}
+
+static inline int joinBytes(int low_byte, int high_byte) {
+	return (high_byte << 0x8) | low_byte;
+}
+
+// Operand fetchers, one per addressing mode. Each one reads its operand bytes at pc and returns the effective address.
+// page_penalty is a constant at every call site: 1 for reads (one extra cycle only when indexing crosses a page),
+// 0 for stores and read-modify-write instructions (which always spend that cycle, except the 65C02's MODIFY_PAGED ones).
+// The modes that don't index take it too, so every instruction shape calls them the same way, and ignore it.
+
+static inline int addressIndexedByte(CPU *cpu, int base_address, unsigned char index, int page_penalty) {
+	int final_address = base_address + index;
+	int page_crossed = (final_address ^ base_address) & 0xFF00;
+	
+#ifdef CYCLE_EXACT
+	if(page_crossed || !page_penalty) {
+		dummyRead(cpu, (base_address & 0xFF00) | (final_address & 0xFF)); // high byte is not fixed yet
+	}
+	if(page_crossed && page_penalty) {
+		cpu->pageCrossings++;
+	}
+#else
+	if(page_crossed && page_penalty) {
+		addCycles(cpu, 1); // page boundary crossed, +1 CPU cycle
+		cpu->pageCrossings++;
+	}
+#endif
+	
+	return final_address & 0xFFFF; // indexing past $FFFF wraps to page 0
+}
+
+static inline int addressForImmediateAddressing(CPU *cpu, int page_penalty) {
+	(void)page_penalty;
+	return cpu->pc++;
+}
+
+static inline int addressForZeroPageAddressing(CPU *cpu, int page_penalty) {
+	(void)page_penalty;
+	return fetchByte(cpu);
+}
+
+static inline int addressForZeroPageXAddressing(CPU *cpu, int page_penalty) {
+	(void)page_penalty;
+	unsigned char zeropage_location = fetchByte(cpu);
+	dummyReadZeroPage(cpu, zeropage_location); // X is added on a separate cycle
+	return (zeropage_location + cpu->x) & 0xFF; // removes anything bigger than 0xFF (only 1 byte is allowed)
+}
+
+static inline int addressForZeroPageYAddressing(CPU *cpu, int page_penalty) {
+	(void)page_penalty;
+	unsigned char zeropage_location = fetchByte(cpu);
+	dummyReadZeroPage(cpu, zeropage_location); // Y is added on a separate cycle
+	return (zeropage_location + cpu->y) & 0xFF; // removes anything bigger than 0xFF (only 1 byte is allowed)
+}
+
+static inline int addressForAbsoluteAddressing(CPU *cpu, int page_penalty) {
+	(void)page_penalty;
+	unsigned char low_byte = fetchByte(cpu);
+	unsigned char high_byte = fetchByte(cpu);
+	return joinBytes(low_byte, high_byte);
+}
+
+static inline int addressForAbsoluteXAddressing(CPU *cpu, int page_penalty) {
+	return addressIndexedByte(cpu, addressForAbsoluteAddressing(cpu, page_penalty), cpu->x, page_penalty);
+}
+
+static inline int addressForAbsoluteYAddressing(CPU *cpu, int page_penalty) {
+	return addressIndexedByte(cpu, addressForAbsoluteAddressing(cpu, page_penalty), cpu->y, page_penalty);
+}
+
+static inline int addressForIndexedIndirectAddressing(CPU *cpu, int page_penalty) { // (zpg,X)
+	(void)page_penalty;
+	unsigned char zeropage_location = fetchByte(cpu);
+	dummyReadZeroPage(cpu, zeropage_location); // pointer is read before X is added
+	unsigned char address_low_byte = zeropage_location + cpu->x;
+	unsigned char address_high_byte = address_low_byte + 1;
+	unsigned char low_byte = readZeroPage(cpu, address_low_byte);
+	unsigned char high_byte = readZeroPage(cpu, address_high_byte);
+	return joinBytes(low_byte, high_byte);
+}
+
+static inline int addressForIndirectIndexedAddressing(CPU *cpu, int page_penalty) { // (zpg),Y
+	unsigned char operation_low_byte = fetchByte(cpu);
+	unsigned char operation_high_byte = operation_low_byte + 1;
+	unsigned char low_byte = readZeroPage(cpu, operation_low_byte);
+	unsigned char high_byte = readZeroPage(cpu, operation_high_byte);
+	return addressIndexedByte(cpu, joinBytes(low_byte, high_byte), cpu->y, page_penalty);
+}
+
+static inline int addressForZeroPageIndirectAddressing(CPU *cpu, int page_penalty) { // (zpg), 65C02 only
+	(void)page_penalty;
+	unsigned char operation_low_byte = fetchByte(cpu);
+	unsigned char operation_high_byte = operation_low_byte + 1;
+	unsigned char low_byte = readZeroPage(cpu, operation_low_byte);
+	unsigned char high_byte = readZeroPage(cpu, operation_high_byte);
+	return joinBytes(low_byte, high_byte);
+}
+
+// shifts and rotates set N, Z and C and return the result byte
+static inline int rotateByte(CPU *cpu, int byte, int isLeftShift) {	
+	if(isLeftShift == 1) {
+		byte = (byte << 0x1) | (cpu->ps & 0x1); // carry bit shifted on bit 0
+		updateZeroNegativeAndCarryFlags(cpu, byte);
+	} else {
+		int carry = byte & 0x1;
+		byte = (byte >> 0x1) | ((cpu->ps & 0x1) << 0x7); // carry bit shifted on bit 7
+		cpu->ps = (cpu->ps & 0x7C) | nzFlags[byte] | carry;
+	}
+	
+	return byte & 0xFF;
+}
+
+static inline int arithmeticShiftLeft(CPU *cpu, int operation_byte) {
+	operation_byte <<= 0x1;
+	updateZeroNegativeAndCarryFlags(cpu, operation_byte);
+	
+	return operation_byte & 0xFF;
+}
+
+static inline int logicalShiftRight(CPU *cpu, int operation_byte) {
+	cpu->ps = (cpu->ps & 0x7C) | nzFlags[operation_byte >> 0x1] | (operation_byte & 0x1); // bit 0 goes to carry
+	
+	return operation_byte >> 0x1;
+}
+
+static inline void setOverflowForOperationResult(CPU *cpu, int operation_result) {
+	cpu->ps = (operation_result < -128 || operation_result > 127) ? (cpu->ps | 0x40) : (cpu->ps & 0xBF);
+}
+
+static inline void addWithCarry(CPU *cpu, int operation_byte) {
+	int carry = cpu->ps & 0x1;
+	int result = cpu->a + operation_byte + carry;
+	
+	cpu->ps = ((result >> 0x8) == 0 ? cpu->ps & 0xFE : cpu->ps | 0x1); // updates carry bit (0) on processor status flag
+	
+	setOverflowForOperationResult(cpu, (signed char)cpu->a + (signed char)operation_byte + carry); // carry added after the sign conversion ($7F + carry is +128, not -128)
+	
+	cpu->a = result & 0xFF; // just get first 8 bits
+	updateZeroAndNegativeFlags(cpu, cpu->a);
+}
+
+static inline void subtractWithCarry(CPU *cpu, int operation_byte) {
+	int borrow = (cpu->ps & 0x1) ^ 0x1; // carry off borrows one
+	int result = cpu->a - operation_byte - borrow;
+	
+	cpu->ps = ((result >> 0x8) != 0 ? cpu->ps & 0xFE : cpu->ps | 0x1); // updates carry bit (0) on processor status flag
+	
+	setOverflowForOperationResult(cpu, (signed char)cpu->a - (signed char)operation_byte - borrow); // borrow taken after the sign conversion
+	
+	cpu->a = result & 0xFF; // just get first 8 bits
+	updateZeroAndNegativeFlags(cpu, cpu->a);
+}
+
+static inline void compareBytes(CPU *cpu, unsigned char byte1, unsigned char byte2) {
+	updateZeroNegativeAndCarryFlags(cpu, byte1 + 0x100 - byte2); // bit 8 stays on when byte1 >= byte2 (no borrow)
+}
+
+static inline void testByte(CPU *cpu, unsigned char byte) {
+	cpu->ps = (cpu->ps & 0x3D) | (byte & 0xC0) | (nzFlags[byte & cpu->a] & 0x2); // bits 7 and 6 come from byte, zero flag from (byte & accumulator)
+}
+
+static inline void branchToRelativeAddressIf(CPU *cpu, signed char relative_address, int condition) {
+	coverBranch(cpu, (cpu->pc - 2) & 0xFFFF, condition); // the branch opcode, pc is past the operand
+	if(!condition) return;
+	
+	int branch_location = cpu->pc + relative_address;
+	int page_crossed = (branch_location & 0xFF00) != (cpu->pc & 0xFF00); // either way, pc is already past the operand
+	
+	dummyRead(cpu, cpu->pc);
+	if(page_crossed) {
+		dummyRead(cpu, (cpu->pc & 0xFF00) | (branch_location & 0xFF)); // high byte is not fixed yet
+		cpu->pageCrossings++;
+	}
+	
+	cpu->pc = branch_location;
+	addCycles(cpu, page_crossed ? 2 : 1); // taken, +1 more for a different page
+}
+
+// Operations, one per instruction. opcodes.h pairs each of them with its opcodes, addressing modes and cycles.
+
+// reads: receive the operand byte
+static inline void orWithAccumulator(CPU *cpu, unsigned char operand) {
+	cpu->a |= operand;
+	updateZeroAndNegativeFlags(cpu, cpu->a);
+}
+
+static inline void andWithAccumulator(CPU *cpu, unsigned char operand) {
+	cpu->a &= operand;
+	updateZeroAndNegativeFlags(cpu, cpu->a);
+}
+
+static inline void exclusiveOrWithAccumulator(CPU *cpu, unsigned char operand) {
+	cpu->a ^= operand;
+	updateZeroAndNegativeFlags(cpu, cpu->a);
+}
+
+static inline void compareWithAccumulator(CPU *cpu, unsigned char operand) {
+	compareBytes(cpu, cpu->a, operand);
+}
+
+static inline void compareWithX(CPU *cpu, unsigned char operand) {
+	compareBytes(cpu, cpu->x, operand);
+}
+
+static inline void compareWithY(CPU *cpu, unsigned char operand) {
+	compareBytes(cpu, cpu->y, operand);
+}
+
+static inline void loadAccumulator(CPU *cpu, unsigned char operand) {
+	cpu->a = operand;
+	updateZeroAndNegativeFlags(cpu, cpu->a);
+}
+
+static inline void loadX(CPU *cpu, unsigned char operand) {
+	cpu->x = operand;
+	updateZeroAndNegativeFlags(cpu, cpu->x);
+}
+
+static inline void loadY(CPU *cpu, unsigned char operand) {
+	cpu->y = operand;
+	updateZeroAndNegativeFlags(cpu, cpu->y);
+}
+
+// writes: return the byte to store
+static inline unsigned char storeAccumulator(CPU *cpu) {
+	return cpu->a;
+}
+
+static inline unsigned char storeX(CPU *cpu) {
+	return cpu->x;
+}
+
+static inline unsigned char storeY(CPU *cpu) {
+	return cpu->y;
+}
+
+// read-modify-writes: return the modified byte
+static inline unsigned char rotateLeft(CPU *cpu, unsigned char operand) {
+	return rotateByte(cpu, operand, 1);
+}
+
+static inline unsigned char rotateRight(CPU *cpu, unsigned char operand) {
+	return rotateByte(cpu, operand, 0);
+}
+
+static inline unsigned char incrementByte(CPU *cpu, unsigned char operand) {
+	operand += 0x1;
+	updateZeroAndNegativeFlags(cpu, operand);
+	return operand;
+}
+
+static inline unsigned char decrementByte(CPU *cpu, unsigned char operand) {
+	operand -= 0x1;
+	updateZeroAndNegativeFlags(cpu, operand);
+	return operand;
+}
+
+// implied
+static inline void clearCarry(CPU *cpu) {
+	cpu->ps &= 0xFE; // clean carry bit (0)
+}
+
+static inline void setCarry(CPU *cpu) {
+	cpu->ps |= 0x1; // turn carry bit (0) on
+}
+
+static inline void clearInterruptDisable(CPU *cpu) {
+	cpu->ps &= 0xFB; // turn interrupt bit (2) off
+}
+
+static inline void setInterruptDisable(CPU *cpu) {
+	cpu->ps |= 0x4; // set interrupt disable bit (2) on
+}
+
+static inline void clearOverflow(CPU *cpu) {
+	cpu->ps &= 0xBF; // set overflow bit off (bit 6)
+}
+
+static inline void clearDecimal(CPU *cpu) {
+	cpu->ps &= 0xF7;
+}
+
+static inline void setDecimal(CPU *cpu) {
+	printf("Decimal flag is not supported on this emulator.\n");
+}
+
+static inline void noOperation(CPU *cpu) {
+}
+
+static inline void transferAccumulatorToX(CPU *cpu) {
+	cpu->x = cpu->a;
+	updateZeroAndNegativeFlags(cpu, cpu->x);
+}
+
+static inline void transferAccumulatorToY(CPU *cpu) {
+	cpu->y = cpu->a;
+	updateZeroAndNegativeFlags(cpu, cpu->y);
+}
+
+static inline void transferXToAccumulator(CPU *cpu) {
+	cpu->a = cpu->x;
+	updateZeroAndNegativeFlags(cpu, cpu->a);
+}
+
+static inline void transferYToAccumulator(CPU *cpu) {
+	cpu->a = cpu->y;
+	updateZeroAndNegativeFlags(cpu, cpu->a);
+}
+
+static inline void transferStackPointerToX(CPU *cpu) {
+	cpu->x = cpu->sp;
+	updateZeroAndNegativeFlags(cpu, cpu->x);
+}
+
+static inline void transferXToStackPointer(CPU *cpu) {
+	cpu->sp = cpu->x; // the only transfer that leaves the flags alone
+}
+
+static inline void incrementX(CPU *cpu) {
+	cpu->x += 0x1;
+	updateZeroAndNegativeFlags(cpu, cpu->x);
+}
+
+static inline void incrementY(CPU *cpu) {
+	cpu->y += 0x1;
+	updateZeroAndNegativeFlags(cpu, cpu->y);
+}
+
+static inline void decrementX(CPU *cpu) {
+	cpu->x -= 0x1;
+	updateZeroAndNegativeFlags(cpu, cpu->x);
+}
+
+static inline void decrementY(CPU *cpu) {
+	cpu->y -= 0x1;
+	updateZeroAndNegativeFlags(cpu, cpu->y);
+}
+
+static inline void pushAccumulator(CPU *cpu) {
+	pushByteToStack(cpu, cpu->a);
+}
+
+static inline void pushStatus(CPU *cpu) {
+	pushByteToStack(cpu, cpu->ps);
+}
+
+static inline void pullAccumulator(CPU *cpu) {
+	dummyReadStack(cpu); // stack pointer is incremented on a separate cycle
+	cpu->a = pullByteFromStack(cpu);
+	updateZeroAndNegativeFlags(cpu, cpu->a);
+}
+
+static inline void pullStatus(CPU *cpu) {
+	dummyReadStack(cpu); // stack pointer is incremented on a separate cycle
+	cpu->ps = pullByteFromStack(cpu);
+}
+
+static inline void returnFromInterrupt(CPU *cpu) {
+	dummyReadStack(cpu); // stack pointer is incremented on a separate cycle
+	cpu->ps = pullByteFromStack(cpu);
+	unsigned char low_byte = pullByteFromStack(cpu); // pull second byte of program counter on stack
+	unsigned char high_byte = pullByteFromStack(cpu); // pull first byte of program counter on stack
+	cpu->pc = joinBytes(low_byte, high_byte);
+}
+
+static inline void returnFromSubroutine(CPU *cpu) {
+	dummyReadStack(cpu); // stack pointer is incremented on a separate cycle
+	unsigned char low_byte = pullByteFromStack(cpu); // pull second byte of program counter on stack
+	unsigned char high_byte = pullByteFromStack(cpu); // pull first byte of program counter on stack
+	int absolute_address = joinBytes(low_byte, high_byte);
+	dummyRead(cpu, absolute_address);
+	cpu->pc = absolute_address + 1; // JSR pushes the address of its last byte
+}
+
+// control flow: everything after the opcode fetch
+static inline void forceBreak(CPU *cpu) {
+	dummyRead(cpu, cpu->pc++); // BRK skips the byte after the opcode
+	int program_counter = cpu->pc;
+	pushByteToStack(cpu, program_counter >> 0x8); // push second byte of program counter on stack
+	pushByteToStack(cpu, program_counter & 0xFF); // push first byte of program counter on stack
+	pushByteToStack(cpu, cpu->ps | 0x10); // pushed copy has the break flag on
+	cpu->ps |= 0x4; // interrupt disabled is on
+	unsigned char low_byte = readByte(cpu, 0xFFFE);
+	unsigned char high_byte = readByte(cpu, 0xFFFF);
+	cpu->pc = joinBytes(low_byte, high_byte);
+}
+
+static inline void jumpToSubroutine(CPU *cpu) {
+	unsigned char low_byte = fetchByte(cpu);
+	dummyReadStack(cpu);
+	
+	int program_counter = cpu->pc; // high byte is fetched only after the return address is pushed
+	pushByteToStack(cpu, program_counter >> 0x8); // push second byte of program counter on stack
+	pushByteToStack(cpu, program_counter & 0xFF); // push first byte of program counter on stack
+	unsigned char high_byte = fetchByte(cpu);
+	cpu->pc = joinBytes(low_byte, high_byte);
+}
+
+static inline void jumpAbsolute(CPU *cpu) {
+	cpu->pc = addressForAbsoluteAddressing(cpu, 0);
+}
+
+static inline void jumpIndirect(CPU *cpu) {
+	int indirect_mem_location = addressForAbsoluteAddressing(cpu, 0);
+	unsigned char low_byte = readByte(cpu, indirect_mem_location);
+	unsigned char high_byte = readByte(cpu, (indirect_mem_location & 0xFF00) | ((indirect_mem_location + 1) & 0xFF)); // NMOS bug: the pointer's high byte never crosses the page
+	cpu->pc = joinBytes(low_byte, high_byte);
+}
+
+// 65C02 only, see opcodes_65c02.h
+static inline void testByteImmediate(CPU *cpu, unsigned char operand) {
+	cpu->ps = (cpu->ps & 0xFD) | (nzFlags[operand & cpu->a] & 0x2); // BIT #imm only changes the zero flag
+}
+
+static inline unsigned char storeZero(CPU *cpu) {
+	return 0;
+}
+
+static inline unsigned char testAndResetBits(CPU *cpu, unsigned char operand) {
+	cpu->ps = (cpu->ps & 0xFD) | (nzFlags[operand & cpu->a] & 0x2);
+	return operand & ~cpu->a;
+}
+
+static inline unsigned char testAndSetBits(CPU *cpu, unsigned char operand) {
+	cpu->ps = (cpu->ps & 0xFD) | (nzFlags[operand & cpu->a] & 0x2);
+	return operand | cpu->a;
+}
+
+static inline void pushX(CPU *cpu) {
+	pushByteToStack(cpu, cpu->x);
+}
+
+static inline void pushY(CPU *cpu) {
+	pushByteToStack(cpu, cpu->y);
+}
+
+static inline void pullX(CPU *cpu) {
+	dummyReadStack(cpu); // stack pointer is incremented on a separate cycle
+	cpu->x = pullByteFromStack(cpu);
+	updateZeroAndNegativeFlags(cpu, cpu->x);
+}
+
+static inline void pullY(CPU *cpu) {
+	dummyReadStack(cpu); // stack pointer is incremented on a separate cycle
+	cpu->y = pullByteFromStack(cpu);
+	updateZeroAndNegativeFlags(cpu, cpu->y);
+}
+
+static inline void jumpIndirectFixed(CPU *cpu) {
+	int indirect_mem_location = addressForAbsoluteAddressing(cpu, 0);
+	dummyRead(cpu, cpu->pc - 1); // the extra cycle the 65C02 spends fixing the page wrap
+	unsigned char low_byte = readByte(cpu, indirect_mem_location);
+	unsigned char high_byte = readByte(cpu, (indirect_mem_location + 1) & 0xFFFF);
+	cpu->pc = joinBytes(low_byte, high_byte);
+}
+
+static inline void jumpIndexedIndirect(CPU *cpu) { // JMP (abs,X)
+	int indirect_mem_location = addressForAbsoluteAddressing(cpu, 0);
+	dummyRead(cpu, cpu->pc - 1); // X is added on a separate cycle
+	indirect_mem_location = (indirect_mem_location + cpu->x) & 0xFFFF;
+	unsigned char low_byte = readByte(cpu, indirect_mem_location);
+	unsigned char high_byte = readByte(cpu, (indirect_mem_location + 1) & 0xFFFF);
+	cpu->pc = joinBytes(low_byte, high_byte);
+}
+
+// undocumented NMOS, see opcodes_undocumented.h; most are two documented operations fused on one operand
+static inline void ignoreOperand(CPU *cpu, unsigned char operand) { // NOPs that still read their operand
+}
+
+static inline void loadAccumulatorAndX(CPU *cpu, unsigned char operand) { // LAX
+	cpu->a = cpu->x = operand;
+	updateZeroAndNegativeFlags(cpu, operand);
+}
+
+static inline unsigned char storeAccumulatorAndX(CPU *cpu) { // SAX
+	return cpu->a & cpu->x;
+}
+
+static inline unsigned char shiftLeftAndOr(CPU *cpu, unsigned char operand) { // SLO
+	operand = arithmeticShiftLeft(cpu, operand);
+	orWithAccumulator(cpu, operand);
+	return operand;
+}
+
+static inline unsigned char rotateLeftAndAnd(CPU *cpu, unsigned char operand) { // RLA
+	operand = rotateByte(cpu, operand, 1);
+	andWithAccumulator(cpu, operand);
+	return operand;
+}
+
+static inline unsigned char shiftRightAndExclusiveOr(CPU *cpu, unsigned char operand) { // SRE
+	operand = logicalShiftRight(cpu, operand);
+	exclusiveOrWithAccumulator(cpu, operand);
+	return operand;
+}
+
+static inline unsigned char rotateRightAndAdd(CPU *cpu, unsigned char operand) { // RRA
+	operand = rotateByte(cpu, operand, 0);
+	addWithCarry(cpu, operand); // carry out of the rotate is the carry in of the addition
+	return operand;
+}
+
+static inline unsigned char decrementAndCompare(CPU *cpu, unsigned char operand) { // DCP
+	operand -= 0x1;
+	compareBytes(cpu, cpu->a, operand);
+	return operand;
+}
+
+static inline unsigned char incrementAndSubtract(CPU *cpu, unsigned char operand) { // ISC
+	operand += 0x1;
+	subtractWithCarry(cpu, operand);
+	return operand;
+}
+
+static inline void andWithCarry(CPU *cpu, unsigned char operand) { // ANC: N is copied to C
+	andWithAccumulator(cpu, operand);
+	cpu->ps = (cpu->ps & 0xFE) | (cpu->a >> 0x7);
+}
+
+static inline void andAndShiftRight(CPU *cpu, unsigned char operand) { // ALR
+	cpu->a = logicalShiftRight(cpu, cpu->a & operand);
+}
+
+static inline void andAndRotateRight(CPU *cpu, unsigned char operand) { // ARR: C from bit 6, V from bit 6 xor bit 5
+	cpu->a = ((cpu->a & operand) >> 0x1) | ((cpu->ps & 0x1) << 0x7);
+	cpu->ps = (cpu->ps & 0x3C) | nzFlags[cpu->a] | ((cpu->a >> 0x6) & 0x1) | ((cpu->a ^ (cpu->a << 0x1)) & 0x40);
+}
+
+static inline void subtractFromAccumulatorAndX(CPU *cpu, unsigned char operand) { // SBX: X = (A & X) - operand, flags as CMP
+	compareBytes(cpu, cpu->a & cpu->x, operand);
+	cpu->x = (cpu->a & cpu->x) - operand;
+}
+
+// Instruction shapes used by the opcode tables (opcodes.h, opcodes_nmos.h, opcodes_65c02.h), one block of statements
+// each, run with pc just past the opcode: cpu.c makes each one a case of a step function's switch, recompiled code
+// (recompile.c) runs them straight. The addressing mode and page_penalty are compile-time constants in every
+// expansion, so each one gets its own specialized operand fetch.
+
+#define READ_INSTRUCTION(operation, mode, cycles) { \
+	operation(cpu, readOperand(cpu, addressFor##mode##Addressing(cpu, 1), OPERAND_##mode)); \
+	addCycles(cpu, cycles); \
+}
+
+#define WRITE_INSTRUCTION(operation, mode, cycles) { \
+	int mem_location = addressFor##mode##Addressing(cpu, 0); \
+	writeOperand(cpu, mem_location, operation(cpu), OPERAND_##mode); \
+	addCycles(cpu, cycles); \
+}
+
+#define MODIFY_INSTRUCTION(operation, mode, cycles) { \
+	int mem_location = addressFor##mode##Addressing(cpu, 0); \
+	unsigned char mem_value = readOperand(cpu, mem_location, OPERAND_##mode); \
+	dummyWrite(cpu, mem_location, mem_value); /* read-modify-write stores the unmodified value first */ \
+	writeOperand(cpu, mem_location, operation(cpu, mem_value), OPERAND_##mode); \
+	addCycles(cpu, cycles); \
+}
+
+#define MODIFY_PAGED_INSTRUCTION(operation, mode, cycles) { \
+	int mem_location = addressFor##mode##Addressing(cpu, 1); /* the indexing cycle only when it crosses a page */ \
+	unsigned char mem_value = readOperand(cpu, mem_location, OPERAND_##mode); \
+	dummyRead(cpu, mem_location); /* the 65C02 reads the operand again instead of storing it back unmodified */ \
+	writeOperand(cpu, mem_location, operation(cpu, mem_value), OPERAND_##mode); \
+	addCycles(cpu, cycles); \
+}
+
+#define MODIFY_ACCUMULATOR_INSTRUCTION(operation, cycles) { \
+	dummyRead(cpu, cpu->pc); \
+	cpu->a = operation(cpu, cpu->a); \
+	addCycles(cpu, cycles); \
+}
+
+#define IMPLIED_INSTRUCTION(operation, cycles) { \
+	dummyRead(cpu, cpu->pc); \
+	operation(cpu); \
+	addCycles(cpu, cycles); \
+}
+
+#define BRANCH_INSTRUCTION(condition) { \
+	int branch_address = fetchByte(cpu); \
+	branchToRelativeAddressIf(cpu, branch_address, (condition)); \
+	addCycles(cpu, 2); \
+}
+
+#define CONTROL_INSTRUCTION(operation, cycles) { \
+	operation(cpu); \
+	addCycles(cpu, cycles); \
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
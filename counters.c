@@ -0,0 +1,127 @@
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "counters.h"
+
+#define COUNTER_MAGIC 0x32303536 // "6502"
+#define COUNTER_FIELDS (sizeof(CounterValues) / sizeof(unsigned long))
+#define CACHE_LINE 64
+
+// the segment is this header followed by slotCount slots
+typedef struct {
+	unsigned int magic;
+	unsigned int slotCount;
+	unsigned char padding[CACHE_LINE - 2 * sizeof(unsigned int)];
+} CounterHeader;
+
+typedef struct {
+	_Alignas(CACHE_LINE) _Atomic unsigned long fields[COUNTER_FIELDS]; // in CounterValues order
+} CounterSlot;
+
+struct CounterSegment {
+	CounterHeader *header; // start of the mapping
+	CounterSlot *slots;
+	size_t size;
+	char *name; // set for the creator only
+};
+
+static CounterSegment *mapSegment(int file, size_t size, int writable) {
+	CounterSegment *segment = calloc(1, sizeof(CounterSegment));
+	void *mapping = mmap(NULL, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, file, 0);
+	
+	close(file);
+	if(segment == NULL || mapping == MAP_FAILED) {
+		if(mapping != MAP_FAILED) {
+			munmap(mapping, size);
+		}
+		free(segment);
+		return NULL;
+	}
+	segment->header = mapping;
+	segment->slots = (CounterSlot *)(segment->header + 1);
+	segment->size = size;
+	return segment;
+}
+
+CounterSegment *createCounterSegment(const char *name, int slots) {
+	size_t size = sizeof(CounterHeader) + sizeof(CounterSlot) * slots;
+	int file = shm_open(name, O_CREAT | O_RDWR | O_TRUNC, 0644);
+	CounterSegment *segment;
+	
+	if(file < 0) {
+		return NULL;
+	}
+	if(slots <= 0 || ftruncate(file, size) < 0) {
+		close(file);
+		shm_unlink(name);
+		return NULL;
+	}
+	segment = mapSegment(file, size, 1); // closes file
+	if(segment == NULL) {
+		shm_unlink(name);
+		return NULL;
+	}
+	
+	segment->header->slotCount = slots; // the mapping starts out zeroed
+	atomic_thread_fence(memory_order_release);
+	segment->header->magic = COUNTER_MAGIC;
+	segment->name = strdup(name);
+	return segment;
+}
+
+CounterSegment *openCounterSegment(const char *name) {
+	int file = shm_open(name, O_RDONLY, 0);
+	CounterHeader header;
+	
+	if(file < 0) {
+		return NULL;
+	}
+	if(pread(file, &header, sizeof(header), 0) != sizeof(header) || header.magic != COUNTER_MAGIC) {
+		close(file);
+		return NULL;
+	}
+	return mapSegment(file, sizeof(CounterHeader) + sizeof(CounterSlot) * header.slotCount, 0);
+}
+
+void closeCounterSegment(CounterSegment *segment) {
+	if(segment == NULL) {
+		return;
+	}
+	if(segment->name != NULL) {
+		shm_unlink(segment->name);
+		free(segment->name);
+	}
+	munmap(segment->header, segment->size);
+	free(segment);
+}
+
+int counterSlotCount(CounterSegment *segment) {
+	return segment->header->slotCount;
+}
+
+void addCounters(CounterSegment *segment, int slot, const CounterValues *values) {
+	_Atomic unsigned long *fields = segment->slots[slot].fields;
+	const unsigned long *added = (const unsigned long *)values;
+	struct timespec now;
+	size_t i;
+	
+	for(i = 0; i < COUNTER_FIELDS - 1; i++) { // single writer: load and store, no read-modify-write
+		atomic_store_explicit(&fields[i], atomic_load_explicit(&fields[i], memory_order_relaxed) + added[i], memory_order_relaxed);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	atomic_store_explicit(&fields[COUNTER_FIELDS - 1], now.tv_sec * 1000000000UL + now.tv_nsec, memory_order_relaxed);
+}
+
+void readCounters(CounterSegment *segment, int slot, CounterValues *values) {
+	_Atomic unsigned long *fields = segment->slots[slot].fields;
+	unsigned long *read = (unsigned long *)values;
+	size_t i;
+	
+	for(i = 0; i < COUNTER_FIELDS; i++) {
+		read[i] = atomic_load_explicit(&fields[i], memory_order_relaxed);
+	}
+}
@@ -0,0 +1,41 @@
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Live counters in a POSIX shared memory segment, one slot per CPU instance or server worker, for a monitor
+// in another process (6502_monitor) to read while the emulator runs.
+// Every slot has a single writer and a cache line of its own: the writer adds with relaxed atomic loads and
+// stores (no locked instructions, no false sharing between threads), readers load relaxed and may see a slot
+// halfway through an update, which for monitoring is fine. Writers publish after each run, not per instruction.
+
+typedef struct {
+	unsigned long instructions; // retired by the interpreter
+	unsigned long cycles; // all guest cycles, skipped ones included
+	unsigned long skippedCycles; // covered by idle loop skipping and host-code idioms instead of instructions
+	unsigned long pageCrossings; // extra cycles from indexing or branching across a page
+	unsigned long faults; // jams on an unknown opcode, counted by the run that hit them
+	unsigned long interrupts; // interrupts taken (none yet, the core has no IRQ/NMI lines)
+	unsigned long runs; // emulatorRun calls or server jobs
+	unsigned long updated; // CLOCK_MONOTONIC nanoseconds of the last update, set by addCounters
+} CounterValues;
+
+typedef struct CounterSegment CounterSegment;
+
+// name is a shm_open name ("/6502"); NULL if it can't be created or (opening) isn't a counter segment
+CounterSegment *createCounterSegment(const char *name, int slots);
+CounterSegment *openCounterSegment(const char *name); // read only
+void closeCounterSegment(CounterSegment *segment); // the creator also removes the name
+
+int counterSlotCount(CounterSegment *segment);
+// adds every field but updated, which it sets to now; only one thread may write a given slot
+void addCounters(CounterSegment *segment, int slot, const CounterValues *values);
+void readCounters(CounterSegment *segment, int slot, CounterValues *values);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
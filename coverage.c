@@ -0,0 +1,308 @@
+#include <ctype.h>
+#include <string.h>
+#include "coverage.h"
+
+#define COVERAGE_LINE_LENGTH 512
+
+typedef struct {
+	int address;
+	int file; // index into the map's files
+	int line;
+} CoverageLine;
+
+struct CoverageMap {
+	char **files;
+	int fileCount;
+	CoverageLine *lines;
+	int lineCount;
+	unsigned char mapped[COVERAGE_BYTES]; // addresses that have their line already
+};
+
+// data directives of common assemblers, besides the ones starting with a dot
+static const char *dataDirectives[] = { "DB", "DW", "DFB", "DDB", "DS", "BYTE", "WORD", "HEX", "ASC", NULL };
+
+Coverage *createCoverage(void) {
+	return calloc(1, sizeof(Coverage));
+}
+
+void freeCoverage(Coverage *coverage) {
+	free(coverage);
+}
+
+void clearCoverage(Coverage *coverage) {
+	memset(coverage, 0, sizeof(Coverage));
+}
+
+void mergeCoverage(Coverage *into, const Coverage *from) {
+	int i;
+	
+	for(i = 0; i < COVERAGE_BYTES; i++) {
+		into->executed[i] |= from->executed[i];
+		into->taken[i] |= from->taken[i];
+		into->notTaken[i] |= from->notTaken[i];
+	}
+}
+
+static int coverageBit(const unsigned char *bitmap, int address) {
+	return (bitmap[address >> 0x3] >> (address & 0x7)) & 0x1;
+}
+
+CoverageMap *createCoverageMap(void) {
+	return calloc(1, sizeof(CoverageMap));
+}
+
+void freeCoverageMap(CoverageMap *map) {
+	int i;
+	
+	if(map == NULL) {
+		return;
+	}
+	for(i = 0; i < map->fileCount; i++) {
+		free(map->files[i]);
+	}
+	free(map->files);
+	free(map->lines);
+	free(map);
+}
+
+// index of file in the map's files, added if it's new; -1 if it can't allocate
+static int fileIndex(CoverageMap *map, const char *file) {
+	int i;
+	
+	for(i = 0; i < map->fileCount; i++) {
+		if(strcmp(map->files[i], file) == 0) {
+			return i;
+		}
+	}
+	char **files = realloc(map->files, sizeof(char *) * (map->fileCount + 1));
+	if(files == NULL) {
+		return -1;
+	}
+	map->files = files;
+	if((files[map->fileCount] = strdup(file)) == NULL) {
+		return -1;
+	}
+	return map->fileCount++;
+}
+
+// "4000 file.asm:12": the only word after the address ends in a colon and a line number
+static int parseSourcePosition(const char *line, int *address, char *file, int *source_line) {
+	char position[COVERAGE_LINE_LENGTH];
+	char *colon, *end;
+	char extra;
+	
+	if(sscanf(line, " %x %511s %c", address, position, &extra) != 2) {
+		return 0;
+	}
+	if((colon = strrchr(position, ':')) == NULL || colon == position || colon[1] == '\0') {
+		return 0;
+	}
+	*source_line = strtol(colon + 1, &end, 10);
+	if(*end != '\0' || *source_line <= 0) {
+		return 0;
+	}
+	*colon = '\0';
+	strcpy(file, position);
+	return 1;
+}
+
+static int isDataDirective(const char *source) {
+	char word[16];
+	int length = 0;
+	int i;
+	
+	if(*source == '.') {
+		return 1;
+	}
+	while(length < (int)sizeof(word) - 1 && (isalnum((unsigned char)source[length]) || source[length] == '_')) {
+		word[length] = toupper((unsigned char)source[length]);
+		length++;
+	}
+	word[length] = '\0';
+	for(i = 0; dataDirectives[i] != NULL; i++) {
+		if(strcmp(word, dataDirectives[i]) == 0) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static int isByteToken(const char *text) {
+	return isxdigit((unsigned char)text[0]) && isxdigit((unsigned char)text[1]) && (text[2] == '\0' || isspace((unsigned char)text[2]));
+}
+
+// "004000r 1  A9 00     LDA #$00": address of an assembler listing line that assembled an instruction, 0 if it isn't one
+static int parseListingLine(const char *line, int *address) {
+	const char *text = line;
+	char *end;
+	
+	while(isspace((unsigned char)*text)) {
+		text++;
+	}
+	if(*text == '$') {
+		text++;
+	}
+	*address = strtol(text, &end, 16);
+	if(end - text < 4 || !isxdigit((unsigned char)*text)) {
+		return 0;
+	}
+	text = end;
+	if(*text == 'r') { // ca65 marks addresses of relocatable segments
+		text++;
+	}
+	if(!isspace((unsigned char)*text)) {
+		return 0;
+	}
+	while(isspace((unsigned char)*text)) {
+		text++;
+	}
+	if(isdigit((unsigned char)text[0]) && (text[1] == '+' || isspace((unsigned char)text[1])) && !isByteToken(text)) {
+		text += 1 + (text[1] == '+'); // ca65's include depth, "2+" in macros
+	}
+	
+	int bytes = 0;
+	while(isspace((unsigned char)*text)) {
+		text++;
+	}
+	while(isByteToken(text)) {
+		bytes++;
+		text += 2;
+		while(isspace((unsigned char)*text)) {
+			text++;
+		}
+	}
+	if(bytes == 0 || *text == '\0' || *text == ';') {
+		return 0;
+	}
+	
+	const char *colon = text;
+	while(isalnum((unsigned char)*colon) || *colon == '_' || *colon == '@') {
+		colon++;
+	}
+	if(*colon == ':') { // a label in front of the instruction
+		text = colon + 1;
+		while(isspace((unsigned char)*text)) {
+			text++;
+		}
+	}
+	return *text != '\0' && *text != ';' && !isDataDirective(text);
+}
+
+static int mapAddress(CoverageMap *map, int address, int file, int line) {
+	if(coverageBit(map->mapped, address)) {
+		return 0;
+	}
+	CoverageLine *lines = realloc(map->lines, sizeof(CoverageLine) * (map->lineCount + 1));
+	if(lines == NULL) {
+		return -1;
+	}
+	map->lines = lines;
+	lines[map->lineCount].address = address;
+	lines[map->lineCount].file = file;
+	lines[map->lineCount++].line = line;
+	map->mapped[address >> 0x3] |= 1 << (address & 0x7);
+	return 1;
+}
+
+int loadCoverageListing(CoverageMap *map, FILE *file, const char *name) {
+	char line[COVERAGE_LINE_LENGTH];
+	char source[COVERAGE_LINE_LENGTH];
+	int listing_line = 0;
+	int mapped = 0;
+	int listing = -1;
+	int address, source_line, result;
+	
+	while(fgets(line, sizeof(line), file) != NULL) {
+		listing_line++;
+		if(parseSourcePosition(line, &address, source, &source_line)) {
+			int index = fileIndex(map, source);
+			if(index < 0) {
+				return -1;
+			}
+			result = mapAddress(map, address & 0xFFFF, index, source_line);
+		} else if(parseListingLine(line, &address)) {
+			if(listing < 0 && (listing = fileIndex(map, name)) < 0) {
+				return -1;
+			}
+			result = mapAddress(map, address & 0xFFFF, listing, listing_line);
+		} else {
+			continue;
+		}
+		if(result < 0) {
+			return -1;
+		}
+		mapped += result;
+	}
+	return mapped;
+}
+
+static int compareLines(const void *first, const void *second) {
+	const CoverageLine *a = first, *b = second;
+	if(a->line != b->line) {
+		return a->line - b->line;
+	}
+	return a->address - b->address;
+}
+
+// BPL, BMI, BVC, BVS, BCC, BCS, BNE and BEQ; not the 65C02's BRA, which can't fall through
+static int isConditionalBranch(unsigned char opcode) {
+	return (opcode & 0x1F) == 0x10;
+}
+
+int writeCoverageLcov(Coverage *coverage, CoverageMap *map, CPU *cpu, FILE *file, const char *test) {
+	CoverageLine *lines;
+	int source, i;
+	
+	if((lines = malloc(sizeof(CoverageLine) * (map->lineCount + 1))) == NULL) {
+		return -1;
+	}
+	for(source = 0; source < map->fileCount; source++) {
+		int count = 0;
+		int lines_hit = 0, lines_found = 0, branches_hit = 0, branches_found = 0;
+		
+		for(i = 0; i < map->lineCount; i++) {
+			if(map->lines[i].file == source) {
+				lines[count++] = map->lines[i];
+			}
+		}
+		qsort(lines, count, sizeof(CoverageLine), compareLines);
+		
+		fprintf(file, "TN:%s\n", test);
+		fprintf(file, "SF:%s\n", map->files[source]);
+		for(i = 0; i < count; ) {
+			int first = i, hit = 0, block = 0;
+			for(; i < count && lines[i].line == lines[first].line; i++) {
+				hit |= coverageBit(coverage->executed, lines[i].address);
+			}
+			fprintf(file, "DA:%i,%i\n", lines[first].line, hit);
+			lines_found++;
+			lines_hit += hit;
+			
+			for(; first < i; first++) {
+				int address = lines[first].address;
+				if(!isConditionalBranch(*memoryByte(cpu, address))) {
+					continue;
+				}
+				if(coverageBit(coverage->executed, address)) {
+					int taken = coverageBit(coverage->taken, address);
+					int not_taken = coverageBit(coverage->notTaken, address);
+					fprintf(file, "BRDA:%i,%i,0,%i\n", lines[first].line, block, taken);
+					fprintf(file, "BRDA:%i,%i,1,%i\n", lines[first].line, block, not_taken);
+					branches_hit += taken + not_taken;
+				} else {
+					fprintf(file, "BRDA:%i,%i,0,-\n", lines[first].line, block);
+					fprintf(file, "BRDA:%i,%i,1,-\n", lines[first].line, block);
+				}
+				branches_found += 2;
+				block++;
+			}
+		}
+		fprintf(file, "BRF:%i\n", branches_found);
+		fprintf(file, "BRH:%i\n", branches_hit);
+		fprintf(file, "LF:%i\n", lines_found);
+		fprintf(file, "LH:%i\n", lines_hit);
+		fprintf(file, "end_of_record\n");
+	}
+	free(lines);
+	return fflush(file) == 0 && !ferror(file) ? 0 : -1;
+}
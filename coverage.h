@@ -0,0 +1,47 @@
+#ifndef COVERAGE_H
+#define COVERAGE_H
+
+#include <stdio.h>
+#include "cpu.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Guest code coverage: with the core built with COVERAGE (make COVERAGE=1), a CPU whose coverage is set marks
+// every address an instruction starts at, and for branches whether they were ever taken and ever not taken
+// (bitmaps in Coverage, cpu.h: a bit set per instruction, nothing counted). emulatorRun stops skipping idle loops
+// while coverage is set (emulatorSetCoverage), so every instruction gets marked.
+// The bitmaps map back to source lines through listings, and the result is written as lcov tracefile (.info)
+// records for genhtml and the tools that read lcov output.
+
+typedef struct CoverageMap CoverageMap;
+
+// NULL if it can't allocate; bitmaps start cleared
+Coverage *createCoverage(void);
+void freeCoverage(Coverage *coverage);
+void clearCoverage(Coverage *coverage);
+// adds what from covered to into, for suites that run several tests
+void mergeCoverage(Coverage *into, const Coverage *from);
+
+CoverageMap *createCoverageMap(void);
+void freeCoverageMap(CoverageMap *map);
+
+// Listing lines are "4000 file.asm:12" (an instruction's address and the source file and line it came from, as
+// converted from an assembler's debug info) or assembler listing lines: an address ($4000, 4000, ca65's 004000r),
+// optionally an include depth, the bytes assembled and the source ("004000r 1  A9 00     LDA #$00"); those map
+// to lines of the listing itself, named name. Listing lines without bytes or source, data directives (.byte,
+// .word, DB...) and anything else are skipped. Addresses have to be absolute (assembled with .org). An address
+// keeps the first line it's mapped to. Returns the number of addresses mapped, -1 if it can't allocate.
+int loadCoverageListing(CoverageMap *map, FILE *file, const char *name);
+
+// One lcov record per source file: DA per mapped line (1 if any instruction on it ran), and for the conditional
+// branches on it (opcodes read from cpu's memory) BRDA taken and not taken, "-" if the branch never ran.
+// test is the TN name. Returns -1 if it couldn't write it all.
+int writeCoverageLcov(Coverage *coverage, CoverageMap *map, CPU *cpu, FILE *file, const char *test);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
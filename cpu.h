@@ -1,19 +1,98 @@
+#ifndef CPU_H
+#define CPU_H
+
 #include <stdio.h>
-// #include "memory.h"
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 #define PAGE_SIZE 256
 #define MEMORY_PAGES 256
 #define MEMORY_SIZE MEMORY_PAGES * PAGE_SIZE
 
+#define CACHE_LINE_SIZE 64
+
+#define BUS_READ 0
+#define BUS_WRITE 1
+
+// instruction set variants, see opcodes_nmos.h and opcodes_65c02.h
+#define CPU_NMOS 0
+#define CPU_65C02 1
+
+typedef struct CPU CPU;
+
+// called once per bus cycle when built with CYCLE_EXACT (type is BUS_READ or BUS_WRITE)
+typedef void (*BusCallback)(CPU *cpu, int address, unsigned char value, int type);
+
+// Takes over guest reads and/or writes to one page (bank registers, I/O devices...).
+// A NULL read or write means that access goes to memory as usual.
+// Pages 0 and 1 (zero page and stack) are never I/O: the core goes straight to memory there and ignores hooks.
 typedef struct {
-	unsigned char **memory;
-	// int programLength;
-	
+	unsigned char (*read)(CPU *cpu, int address, void *context);
+	void (*write)(CPU *cpu, int address, unsigned char value, void *context);
+	void *context;
+} MemoryHook;
+
+// Guest writes of the current instruction, for tracers (trace.h), which empty it after every instruction.
+#define WRITE_LOG_SIZE 8 // more than any instruction writes
+typedef struct {
+	int count;
+	unsigned short addresses[WRITE_LOG_SIZE];
+	unsigned char values[WRITE_LOG_SIZE];
+} WriteLog;
+
+// Guest accesses per address, counted when built with HEATMAP (see heatmap.h). Fetches are the opcode and operand
+// bytes, reads and writes the data the instructions access; dummy accesses (CYCLE_EXACT) aren't counted.
+#define HEATMAP_READ 0
+#define HEATMAP_WRITE 1
+#define HEATMAP_FETCH 2
+#define HEATMAP_KINDS 3
+typedef struct Heatmap {
+	unsigned long long counts[HEATMAP_KINDS][MEMORY_SIZE];
+} Heatmap;
+
+// Guest code coverage, one bit per address, recorded when built with COVERAGE (see coverage.h)
+#define COVERAGE_BYTES (MEMORY_SIZE / 8)
+typedef struct Coverage {
+	unsigned char executed[COVERAGE_BYTES]; // an instruction started at the address
+	unsigned char taken[COVERAGE_BYTES]; // the branch at the address branched
+	unsigned char notTaken[COVERAGE_BYTES]; // the branch at the address fell through
+} Coverage;
+
+// Everything step() touches on every instruction comes first and fits in the first cache line, CYCLE_EXACT's bus
+// callback included. A CPU is aligned to a cache line (its size is a multiple of one), so CPUs side by side in an
+// array or a MemoryPool never share a line between threads; heap allocated ones need aligned_alloc(CACHE_LINE_SIZE, ...).
+struct CPU {
 	// REGISTERS
-	int pc; // program counter is two bytes
-	int cycles;
+	long long cycles; // 64 bit, doesn't wrap
+	unsigned short pc; // program counter is two bytes, so it wraps from $FFFF to $0000 like the real one
 	unsigned char sp, a, x, y, ps; // stack pointer, accumulator, x register, y register, processor status flag;	
 	
+	unsigned char *zeroPage; // memory[0] and memory[1], kept in step by initializeMemory and switchBank
+	unsigned char *stackPage;
+	int variant; // CPU_NMOS (set by initializeCPU) or CPU_65C02, kept across resetCPU
+	int jammed; // cleared by resetCPU
+	unsigned long pageCrossings; // extra cycles spent indexing or branching across a page, cleared by resetCPU
+	WriteLog *writeLog; // NULL unless something traces the guest's writes
+#ifdef CYCLE_EXACT
+	BusCallback busCallback; // sees every read and write, including dummy ones; the last field of the first line
+#endif
+	// in the second line when built with both, or with either and CYCLE_EXACT; only counting builds read them
+#ifdef HEATMAP
+	Heatmap *heatmap; // NULL unless something counts the guest's accesses
+#endif
+#ifdef COVERAGE
+	Coverage *coverage; // NULL unless something records the guest's coverage
+#endif
+	
+	unsigned char *memory[MEMORY_PAGES]; // page table, every page points PAGE_SIZE bytes into ram
+	unsigned char *ram; // backing store for the whole address space
+	MemoryHook *hooks[MEMORY_PAGES]; // NULL for pages that are plain memory
+	int undocumentedOpcodes; // non zero runs the stable undocumented NMOS opcodes instead of crashing on them (off by default)
+	int jamOnUnknownOpcode; // non zero: an unknown opcode sets jammed and leaves pc on it instead of exiting the process (off by default)
+	
 	// processor status flags:
 	// N V - B D I Z C
 	// N = negative flag
@@ -23,4 +102,35 @@ typedef struct {
 	// I = interrupt disabled flag
 	// Z = zero flag
 	// C = carry flag
-} CPU;
\ No newline at end of file
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+// byte at address (16 bit), found through the page table
+static inline unsigned char *memoryByte(CPU *cpu, int address) {
+	return &cpu->memory[address >> 0x8][address & 0xFF];
+}
+
+int initializeCPU(CPU *cpu); // returns -1 if it can't allocate the memory
+void initializeMemory(CPU *cpu, unsigned char *ram);
+void resetCPU(CPU *cpu);
+void freeCPU(CPU *cpu);
+
+void writeMemory(CPU *cpu, char *buffer, int start, int offset);
+void readMemory(CPU *cpu, char *buffer, int start, int offset);
+void printMemory(CPU *cpu);
+
+void step(CPU *cpu); // runs one instruction of cpu->variant's instruction set
+// the per-variant step functions, for run loops that pick one up front instead of checking cpu->variant every instruction
+void stepNMOS(CPU *cpu);
+void step65C02(CPU *cpu);
+// Like those, but when the instruction is the first half of a common pair (CMP #imm or DEX or DEY then BNE, LDA then
+// STA, CLC then ADC, see cpu.c) and the second half follows before end_cycles, runs both from one dispatch. Returns
+// how many instructions ran and leaves the address of the last one in last_pc; for run loops that don't need to
+// stop between any two instructions (emulator.c).
+int stepFusedNMOS(CPU *cpu, long long end_cycles, int *last_pc);
+int stepFused65C02(CPU *cpu, long long end_cycles, int *last_pc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,401 @@
+#include <string.h>
+#include "cpu.h"
+#include "emulator.h"
+#include "idle.h"
+#include "replay.h"
+#include "profiler.h"
+#include "counters.h"
+#include "trace.h"
+
+struct Emulator {
+	CPU cpu; // first member, so bus callbacks can get back to the emulator
+	int stopped;
+	int skipIdleLoops;
+	int fuseInstructions;
+	IdleLoopDetector idleLoop;
+	ReplayLog *replay; // recording or replaying, NULL for neither
+	int replayMode;
+	Profiler *profiler; // NULL when not profiling
+	CounterSegment *counters; // NULL when not publishing
+	int counterSlot;
+	TraceWriter *trace; // NULL when not tracing
+	long instructions; // this emulatorRun so far
+	long skippedCycles;
+	
+	EmulatorInstructionHook instructionHook;
+	void *instructionHookContext;
+	EmulatorBusHook busHook;
+	void *busHookContext;
+};
+
+#ifdef CYCLE_EXACT
+static void forwardBusCycle(CPU *cpu, int address, unsigned char value, int type) {
+	Emulator *emulator = (Emulator *)cpu;
+	emulator->busHook(emulator->busHookContext, address, value, type);
+}
+#endif
+
+Emulator *emulatorCreate(void) {
+	return emulatorCreateVariant(EMULATOR_NMOS);
+}
+
+Emulator *emulatorCreateVariant(int variant) {
+	if(variant != EMULATOR_NMOS && variant != EMULATOR_65C02) {
+		return NULL;
+	}
+	
+	Emulator *emulator = aligned_alloc(CACHE_LINE_SIZE, sizeof(Emulator)); // CPU is cache line aligned
+	if(emulator == NULL) {
+		return NULL;
+	}
+	memset(emulator, 0, sizeof(Emulator));
+	
+	if(initializeCPU(&emulator->cpu) < 0) {
+		free(emulator);
+		return NULL;
+	}
+	emulator->cpu.jamOnUnknownOpcode = 1; // an unknown opcode stops emulatorRun instead of exiting the host
+	emulator->skipIdleLoops = 1;
+	emulator->fuseInstructions = 1;
+	resetIdleLoopDetector(&emulator->idleLoop);
+	emulator->cpu.variant = (variant == EMULATOR_65C02 ? CPU_65C02 : CPU_NMOS);
+	return emulator;
+}
+
+void emulatorDestroy(Emulator *emulator) {
+	if(emulator == NULL) {
+		return;
+	}
+	
+	closeReplayLog(emulator->replay);
+	emulatorStopTrace(emulator);
+	freeCPU(&emulator->cpu);
+	free(emulator);
+}
+
+void emulatorReset(Emulator *emulator) {
+	CPU *cpu = &emulator->cpu;
+	unsigned char vector[2];
+	long long previous_cycles = cpu->cycles;
+	
+	resetCPU(cpu);
+	resetIdleLoopDetector(&emulator->idleLoop);
+	readMemory(cpu, (char *)vector, 0xFFFC, 2);
+	cpu->pc = (vector[1] << 0x8) | vector[0];
+	if(emulator->profiler != NULL && cpu->cycles != previous_cycles) {
+		startProfiler(emulator->profiler, cpu->cycles); // cycles went back to 0, the next sample would be far away
+	}
+	if(emulator->replay != NULL && emulator->replayMode == REPLAY_RECORD) {
+		recordHostRegisters(emulator->replay, previous_cycles);
+	}
+}
+
+// stepFunction is a constant at every call site, so each variant gets its own loop without a check per instruction.
+// It returns how many instructions it ran and leaves the address of the last one in pc.
+static inline void runUntil(Emulator *emulator, long long end_cycles, int (*stepFunction)(CPU *cpu, long long end_cycles, int *pc)) {
+	CPU *cpu = &emulator->cpu;
+	int skip_idle_loops = emulator->skipIdleLoops && emulator->instructionHook == NULL && emulator->trace == NULL; // the hook and the trace have to see every instruction
+#ifdef CYCLE_EXACT
+	skip_idle_loops = skip_idle_loops && cpu->busCallback == NULL;
+#endif
+#ifdef HEATMAP
+	skip_idle_loops = skip_idle_loops && cpu->heatmap == NULL;
+#endif
+#ifdef COVERAGE
+	skip_idle_loops = skip_idle_loops && cpu->coverage == NULL;
+#endif
+	
+	long instructions = 0;
+	long skipped_cycles = 0;
+	
+	while(cpu->cycles < end_cycles && !emulator->stopped && !cpu->jammed) {
+		if(emulator->instructionHook != NULL && emulator->instructionHook(emulator->instructionHookContext, cpu->pc) != 0) {
+			break;
+		}
+		int pc = cpu->pc;
+		instructions += stepFunction(cpu, end_cycles, &pc);
+		if(skip_idle_loops && cpu->pc < pc) {
+			skipped_cycles += skipIdleLoop(&emulator->idleLoop, cpu, pc, end_cycles);
+		}
+	}
+	
+	emulator->instructions += instructions; // kept in locals, stepFunction could change anything behind a pointer
+	emulator->skippedCycles += skipped_cycles;
+}
+
+static int stepSingleNMOS(CPU *cpu, long long end_cycles, int *pc) {
+	stepNMOS(cpu);
+	return 1;
+}
+
+static int stepSingle65C02(CPU *cpu, long long end_cycles, int *pc) {
+	step65C02(cpu);
+	return 1;
+}
+
+static int stepTracingNMOS(CPU *cpu, long long end_cycles, int *pc) {
+	stepNMOS(cpu);
+	traceInstruction(((Emulator *)cpu)->trace, cpu);
+	return 1;
+}
+
+static int stepTracing65C02(CPU *cpu, long long end_cycles, int *pc) {
+	step65C02(cpu);
+	traceInstruction(((Emulator *)cpu)->trace, cpu);
+	return 1;
+}
+
+static void runVariant(Emulator *emulator, long long end_cycles) {
+	int fuse = emulator->fuseInstructions && emulator->instructionHook == NULL; // the hook has to see every instruction
+#ifdef CYCLE_EXACT
+	fuse = fuse && emulator->cpu.busCallback == NULL; // a bus hook could stop the run between the two
+#endif
+	
+	if(emulator->trace != NULL) {
+		runUntil(emulator, end_cycles, emulator->cpu.variant == CPU_65C02 ? stepTracing65C02 : stepTracingNMOS);
+	} else if(emulator->cpu.variant == CPU_65C02) {
+		if(fuse) {
+			runUntil(emulator, end_cycles, stepFused65C02);
+		} else {
+			runUntil(emulator, end_cycles, stepSingle65C02);
+		}
+	} else {
+		if(fuse) {
+			runUntil(emulator, end_cycles, stepFusedNMOS);
+		} else {
+			runUntil(emulator, end_cycles, stepSingleNMOS);
+		}
+	}
+}
+
+// stops at every cycle count where the recording host wrote memory or registers, and makes the same change there
+static void runReplaying(Emulator *emulator, long long end_cycles) {
+	CPU *cpu = &emulator->cpu;
+	
+	while(cpu->cycles < end_cycles && !emulator->stopped && !cpu->jammed) {
+		long long next_stop = nextReplayStop(emulator->replay);
+		if(next_stop >= 0 && next_stop <= cpu->cycles) {
+			applyReplayedHostInput(emulator->replay);
+			resetIdleLoopDetector(&emulator->idleLoop);
+			continue;
+		}
+		
+		long long limit = (next_stop >= 0 && next_stop < end_cycles ? next_stop : end_cycles);
+		runVariant(emulator, limit);
+		if(cpu->cycles < limit) {
+			break; // the instruction hook stopped it, or the CPU jammed
+		}
+	}
+}
+
+static void runSegment(Emulator *emulator, long long end_cycles) {
+	if(emulator->replay != NULL && emulator->replayMode == REPLAY_PLAY) {
+		runReplaying(emulator, end_cycles);
+	} else {
+		runVariant(emulator, end_cycles);
+	}
+}
+
+// runs up to each sample point and samples there, so instructions in between pay nothing for the profiler
+static void runProfiling(Emulator *emulator, long long end_cycles) {
+	CPU *cpu = &emulator->cpu;
+	
+	while(cpu->cycles < end_cycles && !emulator->stopped && !cpu->jammed) {
+		long long next_sample = nextProfilerSample(emulator->profiler);
+		long long limit = (next_sample < end_cycles ? next_sample : end_cycles);
+		
+		runSegment(emulator, limit);
+		if(cpu->cycles >= next_sample) {
+			sampleProfiler(emulator->profiler, cpu);
+		} else if(cpu->cycles < limit) {
+			break; // the instruction hook stopped it, or the CPU jammed
+		}
+	}
+}
+
+long long emulatorRun(Emulator *emulator, long long cycles) {
+	CPU *cpu = &emulator->cpu;
+	long long start_cycles = cpu->cycles;
+	long long end_cycles = start_cycles + cycles;
+	unsigned long start_page_crossings = cpu->pageCrossings;
+	int was_jammed = cpu->jammed;
+	
+	emulator->stopped = 0;
+	emulator->instructions = emulator->skippedCycles = 0;
+	if(emulator->profiler != NULL) {
+		runProfiling(emulator, end_cycles);
+	} else {
+		runSegment(emulator, end_cycles);
+	}
+	
+	if(emulator->counters != NULL) {
+		CounterValues values = { 0 };
+		values.instructions = emulator->instructions;
+		values.cycles = cpu->cycles - start_cycles;
+		values.skippedCycles = emulator->skippedCycles;
+		values.pageCrossings = cpu->pageCrossings - start_page_crossings;
+		values.faults = (cpu->jammed && !was_jammed); // once per jam, not again for every run that returns on it
+		values.runs = 1;
+		addCounters(emulator->counters, emulator->counterSlot, &values);
+	}
+	
+	return cpu->cycles - start_cycles;
+}
+
+void emulatorStop(Emulator *emulator) {
+	emulator->stopped = 1;
+}
+
+void emulatorWriteMemory(Emulator *emulator, const unsigned char *buffer, int start, int length) {
+	writeMemory(&emulator->cpu, (char *)buffer, start, length);
+	resetIdleLoopDetector(&emulator->idleLoop); // an iteration measured before the write may not hold after it
+	if(emulator->replay != NULL && emulator->replayMode == REPLAY_RECORD) {
+		recordHostWrite(emulator->replay, start, buffer, length);
+	}
+}
+
+void emulatorReadMemory(Emulator *emulator, unsigned char *buffer, int start, int length) {
+	readMemory(&emulator->cpu, (char *)buffer, start, length);
+}
+
+void emulatorGetRegisters(Emulator *emulator, EmulatorRegisters *registers) {
+	CPU *cpu = &emulator->cpu;
+	
+	registers->pc = cpu->pc;
+	registers->sp = cpu->sp;
+	registers->a = cpu->a;
+	registers->x = cpu->x;
+	registers->y = cpu->y;
+	registers->ps = cpu->ps;
+	registers->cycles = cpu->cycles;
+}
+
+void emulatorSetRegisters(Emulator *emulator, const EmulatorRegisters *registers) {
+	CPU *cpu = &emulator->cpu;
+	long long previous_cycles = cpu->cycles;
+	
+	cpu->pc = registers->pc;
+	cpu->sp = registers->sp;
+	cpu->a = registers->a;
+	cpu->x = registers->x;
+	cpu->y = registers->y;
+	cpu->ps = registers->ps;
+	cpu->cycles = registers->cycles;
+	resetIdleLoopDetector(&emulator->idleLoop);
+	if(emulator->profiler != NULL && cpu->cycles != previous_cycles) {
+		startProfiler(emulator->profiler, cpu->cycles);
+	}
+	if(emulator->replay != NULL && emulator->replayMode == REPLAY_RECORD) {
+		recordHostRegisters(emulator->replay, previous_cycles);
+	}
+}
+
+static int openReplay(Emulator *emulator, FILE *file, int mode) {
+	emulatorStopReplay(emulator);
+	emulator->replay = openReplayLog(&emulator->cpu, file, mode);
+	emulator->replayMode = mode;
+	resetIdleLoopDetector(&emulator->idleLoop);
+	return emulator->replay != NULL ? 0 : -1;
+}
+
+int emulatorRecord(Emulator *emulator, FILE *file) {
+	return openReplay(emulator, file, REPLAY_RECORD);
+}
+
+int emulatorReplay(Emulator *emulator, FILE *file) {
+	return openReplay(emulator, file, REPLAY_PLAY);
+}
+
+void emulatorStopReplay(Emulator *emulator) {
+	closeReplayLog(emulator->replay);
+	emulator->replay = NULL;
+}
+
+int emulatorReplayDiverged(Emulator *emulator) {
+	return emulator->replay != NULL && replayDiverged(emulator->replay);
+}
+
+void emulatorSetUndocumentedOpcodes(Emulator *emulator, int enabled) {
+	emulator->cpu.undocumentedOpcodes = enabled;
+}
+
+void emulatorSetJamOnUnknownOpcode(Emulator *emulator, int enabled) {
+	emulator->cpu.jamOnUnknownOpcode = enabled;
+}
+
+int emulatorJammed(Emulator *emulator) {
+	return emulator->cpu.jammed;
+}
+
+void emulatorSetIdleLoopSkipping(Emulator *emulator, int enabled) {
+	emulator->skipIdleLoops = enabled;
+}
+
+void emulatorSetInstructionFusion(Emulator *emulator, int enabled) {
+	emulator->fuseInstructions = enabled;
+}
+
+int emulatorStartTrace(Emulator *emulator, FILE *file) {
+	emulatorStopTrace(emulator);
+	emulator->trace = openTraceWriter(&emulator->cpu, file);
+	return emulator->trace != NULL ? 0 : -1;
+}
+
+int emulatorStopTrace(Emulator *emulator) {
+	int result = 0;
+	if(emulator->trace != NULL) {
+		result = closeTraceWriter(emulator->trace);
+		emulator->trace = NULL;
+	}
+	return result;
+}
+
+void emulatorSetProfiler(Emulator *emulator, Profiler *profiler) {
+	emulator->profiler = profiler;
+	if(profiler != NULL) {
+		startProfiler(profiler, emulator->cpu.cycles);
+	}
+}
+
+void emulatorSetCounters(Emulator *emulator, CounterSegment *counters, int slot) {
+	emulator->counters = counters;
+	emulator->counterSlot = slot;
+}
+
+CPU *emulatorGetCPU(Emulator *emulator) {
+	return &emulator->cpu;
+}
+
+void emulatorSetInstructionHook(Emulator *emulator, EmulatorInstructionHook hook, void *context) {
+	emulator->instructionHook = hook;
+	emulator->instructionHookContext = context;
+}
+
+int emulatorSetBusHook(Emulator *emulator, EmulatorBusHook hook, void *context) {
+#ifdef CYCLE_EXACT
+	emulator->busHook = hook;
+	emulator->busHookContext = context;
+	emulator->cpu.busCallback = (hook != NULL ? forwardBusCycle : NULL);
+	return 0;
+#else
+	return -1;
+#endif
+}
+
+int emulatorSetHeatmap(Emulator *emulator, Heatmap *heatmap) {
+#ifdef HEATMAP
+	emulator->cpu.heatmap = heatmap;
+	return 0;
+#else
+	return -1;
+#endif
+}
+
+int emulatorSetCoverage(Emulator *emulator, Coverage *coverage) {
+#ifdef COVERAGE
+	emulator->cpu.coverage = coverage;
+	return 0;
+#else
+	return -1;
+#endif
+}
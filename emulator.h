@@ -0,0 +1,108 @@
+#ifndef EMULATOR_H
+#define EMULATOR_H
+
+// Embedding API: an opaque handle around one CPU and its memory.
+// The layout of CPU (cpu.h) may change between versions, this interface should not.
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct Emulator Emulator;
+struct Profiler; // profiler.h
+struct CounterSegment; // counters.h
+struct Heatmap; // heatmap.h
+struct Coverage; // coverage.h
+
+// instruction sets for emulatorCreateVariant
+#define EMULATOR_NMOS 0
+#define EMULATOR_65C02 1
+
+typedef struct {
+	int pc;
+	unsigned char sp, a, x, y, ps;
+	long long cycles;
+} EmulatorRegisters;
+
+// called before every instruction, returning non zero stops emulatorRun before it runs
+typedef int (*EmulatorInstructionHook)(void *context, int pc);
+
+// called for every bus cycle (type is 0 for reads, 1 for writes), only when the library is built with CYCLE_EXACT
+typedef void (*EmulatorBusHook)(void *context, int address, unsigned char value, int type);
+
+Emulator *emulatorCreate(void); // NMOS 6502, NULL if it can't allocate
+Emulator *emulatorCreateVariant(int variant); // EMULATOR_NMOS or EMULATOR_65C02, NULL for anything else or if it can't allocate
+void emulatorDestroy(Emulator *emulator);
+
+// registers back to their power on values and pc loaded from the reset vector ($FFFC)
+void emulatorReset(Emulator *emulator);
+
+// runs whole instructions until at least the given number of cycles passed, a hook stops it, the CPU jams or
+// emulatorStop is called;
+// returns the cycles actually run
+long long emulatorRun(Emulator *emulator, long long cycles);
+void emulatorStop(Emulator *emulator);
+
+void emulatorWriteMemory(Emulator *emulator, const unsigned char *buffer, int start, int length);
+void emulatorReadMemory(Emulator *emulator, unsigned char *buffer, int start, int length);
+
+void emulatorGetRegisters(Emulator *emulator, EmulatorRegisters *registers);
+void emulatorSetRegisters(Emulator *emulator, const EmulatorRegisters *registers);
+
+// runs the stable undocumented NMOS opcodes (LAX, SAX, DCP, ISC, SLO, RLA, SRE, RRA...) instead of stopping the host on them;
+// off by default, no effect on the 65C02
+void emulatorSetUndocumentedOpcodes(Emulator *emulator, int enabled);
+
+// An unknown opcode jams the CPU (on by default): pc stays on it and emulatorRun returns early, as it does every
+// time until emulatorReset. Turned off, an unknown opcode exits the host process like the bare core does.
+void emulatorSetJamOnUnknownOpcode(Emulator *emulator, int enabled);
+int emulatorJammed(Emulator *emulator); // non zero after an unknown opcode, until emulatorReset
+
+// emulatorRun moves cycles forward over loops that only spin (on by default); the result is the same as running them,
+// unless guest memory can change while emulatorRun is running (another host thread writing it), so turn it off then
+void emulatorSetIdleLoopSkipping(Emulator *emulator, int enabled);
+
+// emulatorRun runs common instruction pairs (CMP #imm or DEX or DEY then BNE, LDA then STA, CLC then ADC) from one
+// dispatch (on by default, see stepFusedNMOS in cpu.h); state, cycles and bus accesses are the same, it only never
+// stops between the two. Off while an instruction hook, a bus hook or a trace is set, which have to see every instruction.
+void emulatorSetInstructionFusion(Emulator *emulator, int enabled);
+
+// Record/replay (see replay.h): recording logs a snapshot and then every device read and every
+// emulatorWriteMemory/emulatorSetRegisters/emulatorReset to file; replaying loads the snapshot and
+// emulatorRun makes the same run again, without the host doing any of those calls. Both return -1 on failure.
+int emulatorRecord(Emulator *emulator, FILE *file);
+int emulatorReplay(Emulator *emulator, FILE *file);
+void emulatorStopReplay(Emulator *emulator); // either one; the file stays open
+int emulatorReplayDiverged(Emulator *emulator); // non zero if the replayed run asked for a read the log doesn't have
+
+// writes a compressed trace of every instruction emulatorRun runs to file (see trace.h), turning idle loop skipping
+// off meanwhile; stop returns -1 if any of it couldn't be written. The file stays open.
+int emulatorStartTrace(Emulator *emulator, FILE *file);
+int emulatorStopTrace(Emulator *emulator);
+
+// samples pc and the call stack every interval cycles of emulatorRun into profiler (see profiler.h), NULL stops;
+// the profiler stays the caller's to write out and free
+void emulatorSetProfiler(Emulator *emulator, struct Profiler *profiler);
+
+// adds what every emulatorRun did to slot of a live counter segment (see counters.h), NULL stops;
+// emulators publishing from different threads need different slots
+void emulatorSetCounters(Emulator *emulator, struct CounterSegment *counters, int slot);
+
+// the CPU inside, for attaching devices (banks.h, console.h); valid until emulatorDestroy
+struct CPU *emulatorGetCPU(Emulator *emulator);
+
+void emulatorSetInstructionHook(Emulator *emulator, EmulatorInstructionHook hook, void *context);
+int emulatorSetBusHook(Emulator *emulator, EmulatorBusHook hook, void *context); // returns -1 if not built with CYCLE_EXACT
+// counts the guest's reads, writes and fetches into heatmap (see heatmap.h), NULL stops; returns -1 if not built with HEATMAP
+int emulatorSetHeatmap(Emulator *emulator, struct Heatmap *heatmap);
+// records the instructions the guest runs and which way its branches go into coverage (see coverage.h), NULL stops;
+// returns -1 if not built with COVERAGE
+int emulatorSetCoverage(Emulator *emulator, struct Coverage *coverage);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef FLAGS_H
+#define FLAGS_H
+
+// Precomputed processor status flags, built by the preprocessor so there is no setup at runtime.
+//
+// nzFlags[result] holds the N (bit 7) and Z (bit 1) flags for a result byte.
+// nzcFlags[result] does the same for a 9 bit result, with bit 8 becoming C (bit 0).
+// That covers compares (byte1 + 0x100 - byte2 carries when byte1 >= byte2) and left shifts/rotates.
+
+#define FLAGS_NZ(value) ((((value) & 0xFF) == 0 ? 0x02 : 0x00) | ((value) & 0x80))
+#define FLAGS_NZC(value) (FLAGS_NZ(value) | (((value) >> 0x8) & 0x1))
+
+#define FLAGS_4(flags, value) flags(value), flags((value) + 1), flags((value) + 2), flags((value) + 3)
+#define FLAGS_16(flags, value) FLAGS_4(flags, value), FLAGS_4(flags, (value) + 4), FLAGS_4(flags, (value) + 8), FLAGS_4(flags, (value) + 12)
+#define FLAGS_64(flags, value) FLAGS_16(flags, value), FLAGS_16(flags, (value) + 16), FLAGS_16(flags, (value) + 32), FLAGS_16(flags, (value) + 48)
+#define FLAGS_256(flags, value) FLAGS_64(flags, value), FLAGS_64(flags, (value) + 64), FLAGS_64(flags, (value) + 128), FLAGS_64(flags, (value) + 192)
+
+static const unsigned char nzFlags[256] = { FLAGS_256(FLAGS_NZ, 0) };
+static const unsigned char nzcFlags[512] = { FLAGS_256(FLAGS_NZC, 0), FLAGS_256(FLAGS_NZC, 256) };
+
+#endif
@@ -0,0 +1,385 @@
+#include <string.h>
+#include "flow.h"
+
+#define FLOW_VECTORS 0xFFFA // NMI, reset, IRQ/BRK
+
+typedef struct {
+	unsigned char length; // 0 for opcodes the CPU doesn't run
+	unsigned char cycles;
+	unsigned char kind;
+	unsigned char access;
+	unsigned char mode;
+} FlowOpcode;
+
+static const unsigned char modeLengths[] = {
+	1, // Implied
+	1, // Accumulator
+	2, // Immediate
+	2, 2, 2, // ZeroPage, ZeroPageX, ZeroPageY
+	3, 3, 3, // Absolute, AbsoluteX, AbsoluteY
+	2, 2, 2, // IndexedIndirect, IndirectIndexed, ZeroPageIndirect
+	2, // Relative
+	3, 3, // Indirect, AbsoluteIndexedIndirect
+};
+
+// kind and addressing mode of each CONTROL operation in the opcode tables
+#define FLOW_KIND_forceBreak FLOW_BREAK
+#define FLOW_MODE_forceBreak FLOW_MODE_Implied
+#define FLOW_KIND_jumpAbsolute FLOW_JUMP
+#define FLOW_MODE_jumpAbsolute FLOW_MODE_Absolute
+#define FLOW_KIND_jumpToSubroutine FLOW_CALL
+#define FLOW_MODE_jumpToSubroutine FLOW_MODE_Absolute
+#define FLOW_KIND_jumpIndirect FLOW_INDIRECT
+#define FLOW_MODE_jumpIndirect FLOW_MODE_Indirect
+#define FLOW_KIND_jumpIndirectFixed FLOW_INDIRECT
+#define FLOW_MODE_jumpIndirectFixed FLOW_MODE_Indirect
+#define FLOW_KIND_jumpIndexedIndirect FLOW_INDIRECT
+#define FLOW_MODE_jumpIndexedIndirect FLOW_MODE_AbsoluteIndexedIndirect
+
+static void setOpcode(FlowOpcode *opcodes, int opcode, int mode, int cycles, int kind, int access) {
+	if(opcodes[opcode].length != 0) {
+		return; // the first table that has it wins, like the step functions' switches
+	}
+	opcodes[opcode].length = modeLengths[mode];
+	opcodes[opcode].cycles = cycles;
+	opcodes[opcode].kind = kind;
+	opcodes[opcode].access = (mode == FLOW_MODE_Immediate ? 0 : access);
+	opcodes[opcode].mode = mode;
+}
+
+// the same tables the step function of cpu's variant is built from
+static void fillOpcodes(FlowOpcode *opcodes, CPU *cpu) {
+	memset(opcodes, 0, sizeof(FlowOpcode) * 256);
+	
+#define READ(opcode, operation, mode, cycles) setOpcode(opcodes, opcode, FLOW_MODE_##mode, cycles, FLOW_STEP, FLOW_ACCESS_READ);
+#define WRITE(opcode, operation, mode, cycles) setOpcode(opcodes, opcode, FLOW_MODE_##mode, cycles, FLOW_STEP, FLOW_ACCESS_WRITE);
+#define MODIFY(opcode, operation, mode, cycles) setOpcode(opcodes, opcode, FLOW_MODE_##mode, cycles, FLOW_STEP, FLOW_ACCESS_READ | FLOW_ACCESS_WRITE);
+#define MODIFY_PAGED MODIFY
+#define MODIFY_ACCUMULATOR(opcode, operation, cycles) setOpcode(opcodes, opcode, FLOW_MODE_Accumulator, cycles, FLOW_STEP, 0);
+#define IMPLIED(opcode, operation, cycles) setOpcode(opcodes, opcode, FLOW_MODE_Implied, cycles, FLOW_STEP, 0);
+#define BRANCH(opcode, condition) setOpcode(opcodes, opcode, FLOW_MODE_Relative, 2, FLOW_BRANCH, 0);
+#define CONTROL(opcode, operation, cycles) setOpcode(opcodes, opcode, FLOW_MODE_##operation, cycles, FLOW_KIND_##operation, 0);
+#include "opcodes.h"
+	if(cpu->variant == CPU_65C02) {
+#include "opcodes_65c02.h"
+		opcodes[0x80].kind = FLOW_JUMP; // BRA always branches (cycles stay the branch base, taken penalty not included)
+	} else {
+#include "opcodes_nmos.h"
+		if(cpu->undocumentedOpcodes) {
+#include "opcodes_undocumented.h"
+		}
+	}
+#undef READ
+#undef WRITE
+#undef MODIFY
+#undef MODIFY_PAGED
+#undef MODIFY_ACCUMULATOR
+#undef IMPLIED
+#undef BRANCH
+#undef CONTROL
+	
+	opcodes[0x00].length = 2; // BRK skips the byte after it
+	opcodes[0x40].kind = FLOW_RETURN; // RTI
+	opcodes[0x60].kind = FLOW_RETURN; // RTS
+}
+
+static unsigned char peekByte(CPU *cpu, int address) {
+	return *memoryByte(cpu, address & 0xFFFF);
+}
+
+static int isReadHooked(CPU *cpu, int address) {
+	MemoryHook *hook = cpu->hooks[(address & 0xFFFF) >> 0x8];
+	return hook != NULL && hook->read != NULL;
+}
+
+// queues address as a block start, once
+static void addLeader(FlowGraph *graph, int *work, int *work_count, int address) {
+	address &= 0xFFFF;
+	if(!(graph->bytes[address] & FLOW_BLOCK_START)) {
+		graph->bytes[address] |= FLOW_BLOCK_START;
+		work[(*work_count)++] = address;
+	}
+}
+
+static void markAccess(FlowGraph *graph, const FlowInstruction *instruction) {
+	int page = instruction->operand >> 0x8;
+	int flags = 0;
+	
+	if(instruction->access & FLOW_ACCESS_READ) {
+		flags |= FLOW_PAGE_READ;
+	}
+	if(instruction->access & FLOW_ACCESS_WRITE) {
+		flags |= FLOW_PAGE_WRITTEN;
+	}
+	switch(instruction->mode) {
+		case FLOW_MODE_ZeroPage: case FLOW_MODE_ZeroPageX: case FLOW_MODE_ZeroPageY: case FLOW_MODE_Absolute:
+			graph->pages[page] |= flags;
+			break;
+		case FLOW_MODE_AbsoluteX: case FLOW_MODE_AbsoluteY: // up to 255 past the base, so maybe the next page too
+			graph->pages[page] |= flags;
+			if(instruction->operand & 0xFF) {
+				graph->pages[(page + 1) & 0xFF] |= flags;
+			}
+			break;
+		case FLOW_MODE_IndexedIndirect: case FLOW_MODE_IndirectIndexed: case FLOW_MODE_ZeroPageIndirect:
+			graph->pages[0] |= FLOW_PAGE_READ; // the pointer; where it points is only known at run time
+			break;
+		case FLOW_MODE_Indirect: case FLOW_MODE_AbsoluteIndexedIndirect:
+			graph->pages[page] |= FLOW_PAGE_READ;
+			break;
+	}
+}
+
+// decodes from start until control leaves the straight line, queueing every address control can go to
+static void decodePath(FlowGraph *graph, CPU *cpu, const FlowOpcode *opcodes, int start, int *work, int *work_count) {
+	int address = start;
+	int i;
+	
+	for(;;) {
+		if(graph->instructionAt[address] >= 0) {
+			if(address != start) {
+				addLeader(graph, work, work_count, address); // a second way in
+			}
+			return;
+		}
+		if(isReadHooked(cpu, address)) {
+			return;
+		}
+		unsigned char opcode = peekByte(cpu, address);
+		const FlowOpcode *decoded = &opcodes[opcode];
+		if(decoded->length == 0) {
+			graph->unknownOpcodes++;
+			return;
+		}
+	
+		FlowInstruction *instruction = &graph->instructions[graph->instructionCount];
+		graph->instructionAt[address] = graph->instructionCount++;
+		instruction->address = address;
+		instruction->opcode = opcode;
+		instruction->length = decoded->length;
+		instruction->cycles = decoded->cycles;
+		instruction->kind = decoded->kind;
+		instruction->access = decoded->access;
+		instruction->mode = decoded->mode;
+		instruction->operand = 0;
+		for(i = 1; i < decoded->length && decoded->kind != FLOW_BREAK; i++) { // BRK's byte is skipped, not an operand
+			instruction->operand |= peekByte(cpu, address + i) << ((i - 1) * 8);
+		}
+	
+		if(graph->bytes[address] & FLOW_OPERAND) {
+			graph->bytes[address] |= FLOW_OVERLAP;
+		}
+		graph->bytes[address] |= FLOW_OPCODE;
+		graph->pages[address >> 0x8] |= FLOW_PAGE_CODE;
+		for(i = 1; i < decoded->length; i++) {
+			int operand_address = (address + i) & 0xFFFF;
+			graph->bytes[operand_address] |= FLOW_OPERAND | (graph->bytes[operand_address] & FLOW_OPCODE ? FLOW_OVERLAP : 0);
+			graph->pages[operand_address >> 0x8] |= FLOW_PAGE_CODE;
+		}
+		markAccess(graph, instruction);
+	
+		int next = (address + decoded->length) & 0xFFFF;
+		switch(decoded->kind) {
+			case FLOW_BRANCH:
+				instruction->target = (next + (signed char)instruction->operand) & 0xFFFF;
+				addLeader(graph, work, work_count, instruction->target);
+				addLeader(graph, work, work_count, next);
+				return;
+			case FLOW_JUMP:
+				instruction->target = (decoded->mode == FLOW_MODE_Relative ? (next + (signed char)instruction->operand) & 0xFFFF : instruction->operand);
+				addLeader(graph, work, work_count, instruction->target);
+				return;
+			case FLOW_CALL:
+				instruction->target = instruction->operand;
+				graph->bytes[instruction->target] |= FLOW_ROUTINE_START;
+				addLeader(graph, work, work_count, instruction->target);
+				addLeader(graph, work, work_count, next);
+				return;
+			case FLOW_RETURN: case FLOW_INDIRECT: case FLOW_BREAK:
+				graph->indirectJumps += (decoded->kind == FLOW_INDIRECT);
+				instruction->target = 0;
+				return;
+		}
+		instruction->target = 0;
+		address = next;
+	}
+}
+
+// instructions in address order, instructionAt pointing into the new order
+static void sortInstructions(FlowGraph *graph) {
+	FlowInstruction *sorted = malloc(sizeof(FlowInstruction) * (graph->instructionCount > 0 ? graph->instructionCount : 1));
+	int address, count = 0;
+	
+	if(sorted == NULL) {
+		return; // keeps the discovery order, instructionAt still right
+	}
+	for(address = 0; address < MEMORY_SIZE; address++) {
+		if(graph->instructionAt[address] >= 0) {
+			sorted[count] = graph->instructions[graph->instructionAt[address]];
+			graph->instructionAt[address] = count++;
+		}
+	}
+	free(graph->instructions);
+	graph->instructions = sorted;
+}
+
+static void buildBlocks(FlowGraph *graph) {
+	int address;
+	
+	for(address = 0; address < MEMORY_SIZE; address++) {
+		if(!(graph->bytes[address] & FLOW_BLOCK_START)) {
+			continue;
+		}
+		if(graph->instructionAt[address] < 0) {
+			graph->bytes[address] &= ~FLOW_BLOCK_START; // nothing decodable there
+			continue;
+		}
+	
+		FlowBlock *block = &graph->blocks[graph->blockCount];
+		graph->blockAt[address] = graph->blockCount++;
+		block->start = address;
+		block->instructionCount = 0;
+		block->cycles = 0;
+		block->routine = -1;
+	
+		int current = address;
+		for(;;) {
+			const FlowInstruction *instruction = &graph->instructions[graph->instructionAt[current]];
+			int next = (current + instruction->length) & 0xFFFF;
+			block->instructionCount++;
+			block->cycles += instruction->cycles;
+	
+			block->successors[0] = -1;
+			block->successors[1] = -1;
+			if(instruction->kind == FLOW_BRANCH || instruction->kind == FLOW_JUMP || instruction->kind == FLOW_CALL) {
+				block->successors[0] = instruction->target;
+			}
+			if(instruction->kind == FLOW_STEP || instruction->kind == FLOW_BRANCH || instruction->kind == FLOW_CALL) {
+				block->successors[1] = next;
+			}
+			if(instruction->kind != FLOW_STEP || (graph->bytes[next] & FLOW_BLOCK_START) || graph->instructionAt[next] < 0) {
+				block->last = current;
+				block->end = next;
+				break;
+			}
+			current = next;
+		}
+	}
+}
+
+static void addRoutine(FlowGraph *graph, int address) {
+	int i;
+	
+	for(i = 0; i < graph->routineCount; i++) {
+		if(graph->routines[i] == address) {
+			return;
+		}
+	}
+	graph->routines[graph->routineCount++] = address;
+}
+
+// every block goes to the first routine that reaches it without calling, in routine order
+static void assignRoutines(FlowGraph *graph) {
+	int *stack = malloc(sizeof(int) * (graph->blockCount > 0 ? graph->blockCount : 1));
+	int routine, i;
+	
+	if(stack == NULL) {
+		return;
+	}
+	for(routine = 0; routine < graph->routineCount; routine++) {
+		int depth = 0;
+		int first = graph->blockAt[graph->routines[routine]];
+		if(first < 0 || graph->blocks[first].routine >= 0) {
+			continue;
+		}
+		graph->blocks[first].routine = routine;
+		stack[depth++] = first;
+		while(depth > 0) {
+			FlowBlock *block = &graph->blocks[stack[--depth]];
+			int calls = (graph->instructions[graph->instructionAt[block->last]].kind == FLOW_CALL);
+			for(i = 0; i < 2; i++) {
+				int successor = block->successors[i];
+				if(successor < 0 || graph->blockAt[successor] < 0 || (i == 0 && calls)) { // the called routine is not part of this one
+					continue;
+				}
+				FlowBlock *next = &graph->blocks[graph->blockAt[successor]];
+				if(next->routine < 0) {
+					next->routine = routine;
+					stack[depth++] = graph->blockAt[successor];
+				}
+			}
+		}
+	}
+	free(stack);
+}
+
+FlowGraph *analyzeFlow(CPU *cpu, const int *entries, int entryCount) {
+	FlowOpcode opcodes[256];
+	FlowGraph *graph = calloc(1, sizeof(FlowGraph));
+	int *work = malloc(sizeof(int) * MEMORY_SIZE);
+	int work_count = 0;
+	int address, i;
+	
+	if(graph != NULL) {
+		graph->instructions = malloc(sizeof(FlowInstruction) * MEMORY_SIZE);
+		graph->blocks = malloc(sizeof(FlowBlock) * MEMORY_SIZE);
+		graph->routines = malloc(sizeof(int) * (MEMORY_SIZE + entryCount + 3));
+	}
+	if(graph == NULL || work == NULL || graph->instructions == NULL || graph->blocks == NULL || graph->routines == NULL) {
+		free(work);
+		freeFlowGraph(graph);
+		return NULL;
+	}
+	fillOpcodes(opcodes, cpu);
+	memset(graph->instructionAt, 0xFF, sizeof(graph->instructionAt)); // -1
+	memset(graph->blockAt, 0xFF, sizeof(graph->blockAt));
+	
+	for(i = 0; i < entryCount; i++) {
+		addRoutine(graph, entries[i] & 0xFFFF);
+	}
+	for(address = FLOW_VECTORS; address < MEMORY_SIZE; address += 2) {
+		int vector = peekByte(cpu, address) | (peekByte(cpu, address + 1) << 0x8);
+		if(vector != 0x0000 && vector != 0xFFFF && !isReadHooked(cpu, address)) {
+			addRoutine(graph, vector);
+		}
+	}
+	for(i = 0; i < graph->routineCount; i++) {
+		graph->bytes[graph->routines[i]] |= FLOW_ROUTINE_START;
+		addLeader(graph, work, &work_count, graph->routines[i]);
+	}
+	
+	while(work_count > 0) {
+		decodePath(graph, cpu, opcodes, work[--work_count], work, &work_count);
+	}
+	free(work);
+	
+	sortInstructions(graph);
+	buildBlocks(graph);
+	for(address = 0; address < MEMORY_SIZE; address++) {
+		if((graph->bytes[address] & FLOW_ROUTINE_START) && graph->blockAt[address] >= 0) {
+			addRoutine(graph, address); // JSR targets, after the entry points
+		}
+	}
+	assignRoutines(graph);
+	return graph;
+}
+
+void freeFlowGraph(FlowGraph *graph) {
+	if(graph == NULL) {
+		return;
+	}
+	free(graph->instructions);
+	free(graph->blocks);
+	free(graph->routines);
+	free(graph);
+}
+
+const FlowBlock *flowBlockAt(const FlowGraph *graph, int address) {
+	int block = graph->blockAt[address & 0xFFFF];
+	return block >= 0 ? &graph->blocks[block] : NULL;
+}
+
+const FlowInstruction *flowInstructionAt(const FlowGraph *graph, int address) {
+	int instruction = graph->instructionAt[address & 0xFFFF];
+	return instruction >= 0 ? &graph->instructions[instruction] : NULL;
+}
@@ -0,0 +1,111 @@
+#ifndef FLOW_H
+#define FLOW_H
+
+#include "cpu.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Static control flow recovery of a guest image, before any of it runs: recursive descent from the entry points
+// (a load address, the NMI/reset/IRQ vectors) follows branches, JMP and JSR targets and the fall through after
+// them, decodes every instruction it reaches with cpu->variant's opcode tables, and cuts the result into basic
+// blocks and routines (an entry point or JSR target, and the blocks it reaches without calling).
+// Pages are marked as code and as read or written by the code's absolute operands, so consumers can tell code
+// that may modify itself. JMP (indirect), RTS/RTI, BRK and unknown opcodes end a path: their targets are only
+// known at run time, so anything reached only through them stays undiscovered.
+// Memory is read through the page table without hooks; pages with a read hook (I/O) are never decoded.
+
+// instruction kinds
+#define FLOW_STEP 0 // falls through
+#define FLOW_BRANCH 1 // relative, to target or falls through
+#define FLOW_JUMP 2 // JMP absolute, to target
+#define FLOW_CALL 3 // JSR, to target, returning after it
+#define FLOW_RETURN 4 // RTS, RTI
+#define FLOW_INDIRECT 5 // JMP (abs), JMP (abs,X): target only known at run time
+#define FLOW_BREAK 6 // BRK, through the IRQ vector
+
+// memory accesses of the operand, for instructions with one
+#define FLOW_ACCESS_READ 0x1
+#define FLOW_ACCESS_WRITE 0x2
+
+// addressing modes, named like the ones in the opcode tables
+#define FLOW_MODE_Implied 0
+#define FLOW_MODE_Accumulator 1
+#define FLOW_MODE_Immediate 2
+#define FLOW_MODE_ZeroPage 3
+#define FLOW_MODE_ZeroPageX 4
+#define FLOW_MODE_ZeroPageY 5
+#define FLOW_MODE_Absolute 6
+#define FLOW_MODE_AbsoluteX 7
+#define FLOW_MODE_AbsoluteY 8
+#define FLOW_MODE_IndexedIndirect 9 // (zpg,X)
+#define FLOW_MODE_IndirectIndexed 10 // (zpg),Y
+#define FLOW_MODE_ZeroPageIndirect 11 // (zpg), 65C02
+#define FLOW_MODE_Relative 12 // branches
+#define FLOW_MODE_Indirect 13 // JMP (abs)
+#define FLOW_MODE_AbsoluteIndexedIndirect 14 // JMP (abs,X), 65C02
+
+// graph->bytes, one per address
+#define FLOW_OPCODE 0x1 // an instruction starts here
+#define FLOW_OPERAND 0x2 // operand byte of an instruction
+#define FLOW_BLOCK_START 0x4
+#define FLOW_ROUTINE_START 0x8
+#define FLOW_OVERLAP 0x10 // both an opcode and an operand (code jumping into the middle of an instruction)
+
+// graph->pages, one per page
+#define FLOW_PAGE_CODE 0x1
+#define FLOW_PAGE_READ 0x2 // read by an absolute operand (or the pointer of a JMP indirect)
+#define FLOW_PAGE_WRITTEN 0x4 // written by an absolute operand
+
+typedef struct {
+	unsigned short address;
+	unsigned char opcode;
+	unsigned char length; // bytes
+	unsigned char cycles; // base cycles, no page crossing or branch taken penalty
+	unsigned char kind; // FLOW_STEP...
+	unsigned char access; // FLOW_ACCESS_* of the operand, 0 for none (immediate, implied, control)
+	unsigned char mode; // FLOW_MODE_*
+	unsigned short operand; // raw operand value (byte or word), 0 without one
+	unsigned short target; // branch, JMP and JSR destination
+} FlowInstruction;
+
+typedef struct {
+	unsigned short start;
+	unsigned short last; // address of the last instruction
+	unsigned short end; // address after it
+	int instructionCount;
+	int cycles; // base cycles of all its instructions
+	int successors[2]; // where control goes next: target (of a branch, JMP or JSR) and fall through (or return point), -1 for none
+	int routine; // index of the first routine that reaches it
+} FlowBlock;
+
+typedef struct {
+	FlowInstruction *instructions; // by address
+	int instructionCount;
+	FlowBlock *blocks; // by start address
+	int blockCount;
+	int *routines; // entry addresses, entry points first, then JSR targets by address
+	int routineCount;
+	int instructionAt[MEMORY_SIZE]; // index into instructions, -1 where none starts
+	int blockAt[MEMORY_SIZE]; // index into blocks, -1 where none starts
+	unsigned char bytes[MEMORY_SIZE]; // FLOW_OPCODE...
+	unsigned char pages[MEMORY_PAGES]; // FLOW_PAGE_*
+	int indirectJumps; // JMP (indirect) found, their targets are not followed
+	int unknownOpcodes; // paths that ran into an opcode cpu doesn't run
+} FlowGraph;
+
+// entries are addresses to start from; the vectors at $FFFA-$FFFF are added unless they are $0000 or $FFFF
+// (unprogrammed). NULL if it can't allocate.
+FlowGraph *analyzeFlow(CPU *cpu, const int *entries, int entryCount);
+void freeFlowGraph(FlowGraph *graph);
+
+// the block starting at address or the instruction starting at address, NULL for none
+const FlowBlock *flowBlockAt(const FlowGraph *graph, int address);
+const FlowInstruction *flowInstructionAt(const FlowGraph *graph, int address);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "cpu.h"
+#include "flow.h"
+
+// Prints the control flow recovered from a guest image: ./6502_flow image [load address [entry ...]]
+// The image is loaded at the load address ($4000 by default, like test.c), which is also the entry point unless
+// others are given; addresses are hex. Routines are listed with their blocks (start-end, instructions, base
+// cycles, successors), then the pages holding code, the ones the code reads or writes, and code pages it writes
+// (self-modifying code, or data next to code).
+
+#define FLOW_DEFAULT_ORIGIN 0x4000
+#define FLOW_MAX_ENTRIES 64
+
+static void printPages(const FlowGraph *graph, const char *name, int flag) {
+	int page;
+
+	printf("%s:", name);
+	for(page = 0; page < MEMORY_PAGES; page++) {
+		if(graph->pages[page] & flag) {
+			printf(" %02x", page);
+		}
+	}
+	printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+	int entries[FLOW_MAX_ENTRIES];
+	int entry_count = 0;
+	int origin = FLOW_DEFAULT_ORIGIN;
+	int routine, i;
+
+	if(argc < 2 || argc - 3 > FLOW_MAX_ENTRIES) {
+		printf("Usage: %s image [load address [entry ...]]\n", argv[0]);
+		return -1;
+	}
+	if(argc > 2) {
+		origin = strtol(argv[2], NULL, 16) & 0xFFFF;
+	}
+	for(i = 3; i < argc; i++) {
+		entries[entry_count++] = strtol(argv[i], NULL, 16) & 0xFFFF;
+	}
+	if(entry_count == 0) {
+		entries[entry_count++] = origin;
+	}
+
+	FILE *file = fopen(argv[1], "rb");
+	if(file == NULL) {
+		printf("Can't open %s.\n", argv[1]);
+		return -1;
+	}
+	char *image = malloc(MEMORY_SIZE);
+	int length = fread(image, 1, MEMORY_SIZE - origin, file);
+	fclose(file);
+
+	CPU cpu;
+	initializeCPU(&cpu);
+	writeMemory(&cpu, image, origin, length);
+	free(image);
+
+	FlowGraph *graph = analyzeFlow(&cpu, entries, entry_count);
+	if(graph == NULL) {
+		printf("Out of memory.\n");
+		freeCPU(&cpu);
+		return -1;
+	}
+
+	printf("FLOW: %i instructions, %i blocks, %i routines, %i indirect jumps, %i unknown opcodes\n", graph->instructionCount,
+		graph->blockCount, graph->routineCount, graph->indirectJumps, graph->unknownOpcodes);
+	for(routine = 0; routine < graph->routineCount; routine++) {
+		printf("routine %04x\n", graph->routines[routine]);
+		for(i = 0; i < graph->blockCount; i++) {
+			const FlowBlock *block = &graph->blocks[i];
+			if(block->routine != routine) {
+				continue;
+			}
+			printf("  %04x-%04x %3i instructions %4i cycles ->", block->start, block->end, block->instructionCount, block->cycles);
+			if(block->successors[0] >= 0) {
+				printf(" %04x", block->successors[0]);
+			}
+			if(block->successors[1] >= 0) {
+				printf(" %04x", block->successors[1]);
+			}
+			printf("\n");
+		}
+	}
+	printPages(graph, "code pages", FLOW_PAGE_CODE);
+	printPages(graph, "read pages", FLOW_PAGE_READ);
+	printPages(graph, "written pages", FLOW_PAGE_WRITTEN);
+	printf("written code pages:");
+	for(i = 0; i < MEMORY_PAGES; i++) {
+		if((graph->pages[i] & FLOW_PAGE_CODE) && (graph->pages[i] & FLOW_PAGE_WRITTEN)) {
+			printf(" %02x", i);
+		}
+	}
+	printf("\n");
+
+	freeFlowGraph(graph);
+	freeCPU(&cpu);
+	return 0;
+}
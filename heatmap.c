@@ -0,0 +1,137 @@
+#include <string.h>
+#include "heatmap.h"
+
+#define HEATMAP_MAGIC "6502HEAT"
+
+typedef struct {
+	int index; // address or page
+	unsigned long long total;
+} HeatmapEntry;
+
+Heatmap *createHeatmap(void) {
+	return calloc(1, sizeof(Heatmap));
+}
+
+void freeHeatmap(Heatmap *heatmap) {
+	free(heatmap);
+}
+
+void clearHeatmap(Heatmap *heatmap) {
+	memset(heatmap, 0, sizeof(Heatmap));
+}
+
+static void sumPages(Heatmap *heatmap, unsigned long long pages[HEATMAP_KINDS][MEMORY_PAGES]) {
+	int kind, address;
+	
+	memset(pages, 0, sizeof(unsigned long long) * HEATMAP_KINDS * MEMORY_PAGES);
+	for(kind = 0; kind < HEATMAP_KINDS; kind++) {
+		for(address = 0; address < MEMORY_SIZE; address++) {
+			pages[kind][address >> 0x8] += heatmap->counts[kind][address];
+		}
+	}
+}
+
+static int writeCounts(const unsigned long long *counts, int count, FILE *file) {
+	unsigned char bytes[8];
+	int i, j;
+	
+	for(i = 0; i < count; i++) {
+		for(j = 0; j < 8; j++) {
+			bytes[j] = (counts[i] >> (j * 8)) & 0xFF;
+		}
+		if(fwrite(bytes, 1, sizeof(bytes), file) != sizeof(bytes)) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int writeHeatmapMatrix(Heatmap *heatmap, FILE *file) {
+	unsigned long long pages[HEATMAP_KINDS][MEMORY_PAGES];
+	int kind;
+	
+	sumPages(heatmap, pages);
+	if(fwrite(HEATMAP_MAGIC, 1, strlen(HEATMAP_MAGIC), file) != strlen(HEATMAP_MAGIC)) {
+		return -1;
+	}
+	for(kind = 0; kind < HEATMAP_KINDS; kind++) {
+		if(writeCounts(heatmap->counts[kind], MEMORY_SIZE, file) != 0) {
+			return -1;
+		}
+	}
+	for(kind = 0; kind < HEATMAP_KINDS; kind++) {
+		if(writeCounts(pages[kind], MEMORY_PAGES, file) != 0) {
+			return -1;
+		}
+	}
+	return fflush(file) == 0 ? 0 : -1;
+}
+
+static int compareEntries(const void *first, const void *second) {
+	const HeatmapEntry *a = first, *b = second;
+	if(a->total != b->total) {
+		return a->total < b->total ? 1 : -1; // most accessed first
+	}
+	return a->index - b->index;
+}
+
+// the indexes with any accesses, most accessed first; returns how many there are
+static int rankEntries(HeatmapEntry *entries, const unsigned long long *reads, const unsigned long long *writes,
+	const unsigned long long *fetches, int size) {
+	int count = 0;
+	int i;
+	
+	for(i = 0; i < size; i++) {
+		unsigned long long total = reads[i] + writes[i] + fetches[i];
+		if(total != 0) {
+			entries[count].index = i;
+			entries[count++].total = total;
+		}
+	}
+	qsort(entries, count, sizeof(HeatmapEntry), compareEntries);
+	return count;
+}
+
+// format prints an index under column
+static void writeRanking(FILE *file, const char *title, const char *column, const char *format, HeatmapEntry *entries, int count, int top,
+	const unsigned long long *reads, const unsigned long long *writes, const unsigned long long *fetches) {
+	int i;
+	
+	fprintf(file, "top %s:\n", title);
+	fprintf(file, "  %-6s %12s %12s %12s %12s\n", column, "reads", "writes", "fetches", "total");
+	for(i = 0; i < count && i < top; i++) {
+		int index = entries[i].index;
+		fprintf(file, "  ");
+		fprintf(file, format, index);
+		fprintf(file, " %12llu %12llu %12llu %12llu\n", reads[index], writes[index], fetches[index], entries[i].total);
+	}
+}
+
+void writeHeatmapReport(Heatmap *heatmap, FILE *file, int top) {
+	unsigned long long pages[HEATMAP_KINDS][MEMORY_PAGES];
+	unsigned long long totals[HEATMAP_KINDS] = {0};
+	HeatmapEntry *entries;
+	int page_count, address_count, kind, page;
+	
+	sumPages(heatmap, pages);
+	for(kind = 0; kind < HEATMAP_KINDS; kind++) {
+		for(page = 0; page < MEMORY_PAGES; page++) {
+			totals[kind] += pages[kind][page];
+		}
+	}
+	if((entries = malloc(sizeof(HeatmapEntry) * MEMORY_SIZE)) == NULL) {
+		fprintf(file, "HEATMAP: out of memory\n");
+		return;
+	}
+	
+	address_count = rankEntries(entries, heatmap->counts[HEATMAP_READ], heatmap->counts[HEATMAP_WRITE], heatmap->counts[HEATMAP_FETCH], MEMORY_SIZE);
+	page_count = rankEntries(entries, pages[HEATMAP_READ], pages[HEATMAP_WRITE], pages[HEATMAP_FETCH], MEMORY_PAGES);
+	fprintf(file, "HEATMAP: %llu reads, %llu writes, %llu fetches; working set %i pages, %i addresses\n",
+		totals[HEATMAP_READ], totals[HEATMAP_WRITE], totals[HEATMAP_FETCH], page_count, address_count);
+	writeRanking(file, "pages", "page", "%-6.2x", entries, page_count, top, pages[HEATMAP_READ], pages[HEATMAP_WRITE], pages[HEATMAP_FETCH]);
+	
+	address_count = rankEntries(entries, heatmap->counts[HEATMAP_READ], heatmap->counts[HEATMAP_WRITE], heatmap->counts[HEATMAP_FETCH], MEMORY_SIZE);
+	writeRanking(file, "addresses", "addr", "%-6.4x", entries, address_count, top, heatmap->counts[HEATMAP_READ],
+		heatmap->counts[HEATMAP_WRITE], heatmap->counts[HEATMAP_FETCH]);
+	free(entries);
+}
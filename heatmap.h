@@ -0,0 +1,34 @@
+#ifndef HEATMAP_H
+#define HEATMAP_H
+
+#include <stdio.h>
+#include "cpu.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Memory access heatmap: with the core built with HEATMAP (make HEATMAP=1), a CPU whose heatmap is set counts
+// every read, write and fetch per address (see Heatmap in cpu.h); pages are the sums of their addresses. Without
+// HEATMAP the core has no counting at all and nothing here ever sees a count. emulatorRun stops skipping idle
+// loops while a heatmap is set (emulatorSetHeatmap), so the counts cover every instruction.
+
+// NULL if it can't allocate; counts start at 0
+Heatmap *createHeatmap(void);
+void freeHeatmap(Heatmap *heatmap);
+void clearHeatmap(Heatmap *heatmap);
+
+// Binary matrix for plotting: the magic "6502HEAT", then the reads, writes and fetches of every address
+// (HEATMAP_KINDS rows of MEMORY_SIZE counts), then the same per page (HEATMAP_KINDS rows of MEMORY_PAGES counts),
+// every count 8 bytes little endian. Returns -1 if it couldn't write it all.
+int writeHeatmapMatrix(Heatmap *heatmap, FILE *file);
+
+// Text report: totals, the working set (pages and addresses accessed at all), then the top pages and the top
+// addresses by accesses with their reads, writes and fetches
+void writeHeatmapReport(Heatmap *heatmap, FILE *file, int top);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,226 @@
+#include <string.h>
+#include "idioms.h"
+#include "flags.h"
+
+// operand addressing of the loads and stores a copy or fill loop may use, all indexed by the loop counter
+typedef struct {
+	int indexRegister; // 'X' or 'Y'
+	int base; // absolute address, or the pointer read from zero page for (zp),Y
+	int pointer; // zero page location of the pointer, -1 for absolute
+	int length; // instruction bytes
+} IndexedOperand;
+
+static int decodeIndexedOperand(CPU *cpu, int address, unsigned char absolute_x, unsigned char absolute_y, unsigned char indirect_y, IndexedOperand *operand) {
+	unsigned char opcode = *memoryByte(cpu, address);
+	unsigned char low_byte = *memoryByte(cpu, (address + 1) & 0xFFFF);
+	
+	if(opcode == absolute_x || opcode == absolute_y) {
+		operand->indexRegister = (opcode == absolute_x ? 'X' : 'Y');
+		operand->base = low_byte | (*memoryByte(cpu, (address + 2) & 0xFFFF) << 0x8);
+		operand->pointer = -1;
+		operand->length = 3;
+		return 1;
+	}
+	if(opcode == indirect_y && cpu->hooks[0] == NULL) {
+		operand->indexRegister = 'Y';
+		operand->base = *memoryByte(cpu, low_byte) | (*memoryByte(cpu, (low_byte + 1) & 0xFF) << 0x8);
+		operand->pointer = low_byte;
+		operand->length = 2;
+		return 1;
+	}
+	return 0;
+}
+
+// no hook on any page of [first, last] (any hook for writes, a read hook for reads)
+static int plainPages(CPU *cpu, int first, int last, int writing) {
+	int page;
+	for(page = first >> 0x8; page <= last >> 0x8; page++) {
+		MemoryHook *hook = cpu->hooks[page];
+		if(hook != NULL && (writing || hook->read != NULL)) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static int overlaps(int first1, int last1, int first2, int last2) {
+	return first1 <= last2 && first2 <= last1;
+}
+
+static int pointerOverlaps(const IndexedOperand *operand, int first, int last) {
+	return operand->pointer >= 0 && (overlaps(operand->pointer, operand->pointer, first, last) || overlaps((operand->pointer + 1) & 0xFF, (operand->pointer + 1) & 0xFF, first, last));
+}
+
+static int pageCrossed(int base, int index) {
+	return ((base & 0xFF) + index) > 0xFF;
+}
+
+// LDA src,i / STA dst,i / INX|DEX|INY|DEY / BNE: memcpy, or memset without the load
+static long runCopyOrFill(CPU *cpu, int loop_start, int branch_address, const IdleLoopDetector *previous, long iteration_cycles, long long end_cycles) {
+	IndexedOperand source, destination;
+	int address = loop_start;
+	int copies = decodeIndexedOperand(cpu, address, 0xBD, 0xB9, 0xB1, &source); // LDA abs,X / abs,Y / (zp),Y
+	
+	if(copies) {
+		address += source.length;
+	}
+	if(!decodeIndexedOperand(cpu, address, 0x9D, 0x99, 0x91, &destination)) { // STA abs,X / abs,Y / (zp),Y
+		return 0;
+	}
+	address += destination.length;
+	
+	unsigned char counter_opcode = *memoryByte(cpu, address);
+	int counter_register = (counter_opcode == 0xE8 || counter_opcode == 0xCA ? 'X' : 'Y');
+	int step = (counter_opcode == 0xE8 || counter_opcode == 0xC8 ? 1 : -1);
+	if((counter_opcode != 0xE8 && counter_opcode != 0xCA && counter_opcode != 0xC8 && counter_opcode != 0x88) || address + 1 != branch_address) {
+		return 0;
+	}
+	if(destination.indexRegister != counter_register || (copies && source.indexRegister != counter_register)) {
+		return 0;
+	}
+	
+	unsigned char *counter = (counter_register == 'X' ? &cpu->x : &cpu->y);
+	unsigned char previous_counter = (counter_register == 'X' ? previous->x : previous->y);
+	int other_unchanged = (counter_register == 'X' ? cpu->y == previous->y : cpu->x == previous->x);
+	if(*counter != (unsigned char)(previous_counter + step) || !other_unchanged || cpu->sp != previous->sp || (!copies && cpu->a != previous->a)) {
+		return 0;
+	}
+	
+	// the last iteration falls through the BNE, leave it to the interpreter; a DEX from 0 wraps the index, so wait one iteration
+	int first_index = *counter;
+	int taken = (step > 0 ? 0xFF - first_index : first_index - 1);
+	if(taken <= 0) {
+		return 0;
+	}
+	
+	// iterations only differ by the load's page crossing cycle
+	int previous_crossed = (copies && pageCrossed(source.base, previous_counter));
+	long base_cycles = iteration_cycles - previous_crossed;
+	unsigned long base_page_crossings = cpu->pageCrossings - previous->startPageCrossings - previous_crossed; // the BNE's
+	long cycles = 0;
+	unsigned long page_crossings = 0;
+	int count;
+	for(count = 0; count < taken; count++) {
+		int crossed = (copies && pageCrossed(source.base, first_index + step * count));
+		if(cpu->cycles + cycles + base_cycles + crossed > end_cycles) {
+			break;
+		}
+		cycles += base_cycles + crossed;
+		page_crossings += base_page_crossings + crossed;
+	}
+	if(count == 0) {
+		return 0;
+	}
+	
+	int low_index = (step > 0 ? first_index : first_index - count + 1);
+	int high_index = low_index + count - 1;
+	int destination_first = destination.base + low_index, destination_last = destination.base + high_index;
+	int source_first = source.base + low_index, source_last = source.base + high_index;
+	
+	if(destination_last > 0xFFFF || !plainPages(cpu, destination_first, destination_last, 1) ||
+		overlaps(destination_first, destination_last, loop_start, branch_address + 1) || pointerOverlaps(&destination, destination_first, destination_last)) {
+		return 0;
+	}
+	if(copies && (source_last > 0xFFFF || !plainPages(cpu, source_first, source_last, 0) || pointerOverlaps(&source, destination_first, destination_last))) {
+		return 0;
+	}
+	
+	if(copies && overlaps(source_first, source_last, destination_first, destination_last)) {
+		int i; // overlapping copies repeat bytes: do them one at a time in the loop's order
+		for(i = 0; i < count; i++) {
+			int index = first_index + step * i;
+			cpu->a = *memoryByte(cpu, source.base + index);
+			*memoryByte(cpu, destination.base + index) = cpu->a;
+		}
+	} else {
+		int offset = 0;
+		int length = count;
+		while(offset < length) { // one memcpy/memset per stretch that stays inside a page on both sides
+			int chunk = length - offset;
+			if(chunk > PAGE_SIZE - ((destination_first + offset) & 0xFF)) chunk = PAGE_SIZE - ((destination_first + offset) & 0xFF);
+			if(copies && chunk > PAGE_SIZE - ((source_first + offset) & 0xFF)) chunk = PAGE_SIZE - ((source_first + offset) & 0xFF);
+			if(copies) {
+				memcpy(memoryByte(cpu, destination_first + offset), memoryByte(cpu, source_first + offset), chunk);
+			} else {
+				memset(memoryByte(cpu, destination_first + offset), cpu->a, chunk);
+			}
+			offset += chunk;
+		}
+		if(copies) {
+			cpu->a = *memoryByte(cpu, source.base + first_index + step * (count - 1));
+		}
+	}
+	
+	*counter = first_index + step * count;
+	cpu->ps = (cpu->ps & 0x7D) | nzFlags[*counter];
+	cpu->pageCrossings += page_crossings;
+	return cycles;
+}
+
+// the shift-and-add multiply found in most 6502 code (product high byte in A, low byte back in factor):
+// loop: BCC skip / CLC / ADC addend / skip: ROR A / ROR factor / DEX / BNE loop
+static const unsigned char multiplyLoop[] = { 0x90, 0x03, 0x18, 0x65, 0x00, 0x6A, 0x66, 0x00, 0xCA, 0xD0, 0xF5 };
+
+static long runMultiply(CPU *cpu, int loop_start, int branch_address, const IdleLoopDetector *previous, long iteration_cycles, long long end_cycles) {
+	int i;
+	
+	if(branch_address != loop_start + 9 || cpu->hooks[0] != NULL || ((loop_start + 2) >> 0x8) != ((loop_start + 5) >> 0x8)) {
+		return 0; // skipping the addition must not cross a page, so it costs the same on every path
+	}
+	for(i = 0; i < (int)sizeof(multiplyLoop); i++) {
+		if(i != 4 && i != 7 && *memoryByte(cpu, (loop_start + i) & 0xFFFF) != multiplyLoop[i]) {
+			return 0;
+		}
+	}
+	if(cpu->x != (unsigned char)(previous->x - 1) || cpu->y != previous->y || cpu->sp != previous->sp) {
+		return 0;
+	}
+	
+	unsigned char addend_location = *memoryByte(cpu, loop_start + 4);
+	unsigned char factor_location = *memoryByte(cpu, loop_start + 7);
+	long rest_cycles = iteration_cycles - ((previous->ps & 0x1) ? 7 : 3); // BCC taken is 3, CLC + ADC zp after an untaken BCC is 7
+	unsigned char a = cpu->a, factor = *memoryByte(cpu, factor_location), x = cpu->x, ps = cpu->ps;
+	int carry = ps & 0x1;
+	long cycles = 0;
+	
+	while(x > 1) { // the last iteration falls through the BNE, leave it to the interpreter
+		long next = (carry ? 7 : 3) + rest_cycles;
+		if(cpu->cycles + cycles + next > end_cycles) {
+			break;
+		}
+		cycles += next;
+		
+		if(carry) {
+			unsigned char addend = (addend_location == factor_location ? factor : *memoryByte(cpu, addend_location));
+			int sum = a + addend;
+			ps = (ps & 0xBF) | ((~(a ^ addend) & (a ^ sum) & 0x80) >> 0x1); // V
+			carry = sum >> 0x8;
+			a = sum;
+		}
+		int a_carry = a & 0x1;
+		a = (a >> 0x1) | (carry << 0x7);
+		carry = factor & 0x1;
+		factor = (factor >> 0x1) | (a_carry << 0x7);
+		x--;
+	}
+	if(cycles == 0) {
+		return 0;
+	}
+	
+	cpu->pageCrossings += (cpu->x - x) * (cpu->pageCrossings - previous->startPageCrossings); // only the BNE can cross, the same every iteration
+	cpu->a = a;
+	cpu->x = x;
+	*memoryByte(cpu, factor_location) = factor;
+	cpu->ps = (ps & 0x7C) | nzFlags[x] | carry; // N and Z from DEX
+	return cycles;
+}
+
+long runLoopIdiom(CPU *cpu, int branch_address, const IdleLoopDetector *previous, long iteration_cycles, long long end_cycles) {
+	int loop_start = cpu->pc;
+	long cycles = runCopyOrFill(cpu, loop_start, branch_address, previous, iteration_cycles, end_cycles);
+	
+	if(cycles == 0) {
+		cycles = runMultiply(cpu, loop_start, branch_address, previous, iteration_cycles, end_cycles);
+	}
+	return cycles;
+}
@@ -0,0 +1,24 @@
+#ifndef IDIOMS_H
+#define IDIOMS_H
+
+#include "cpu.h"
+#include "idle.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Guest loops recognized by shape and run as host code: clear/fill loops (STA abs,X / (zp),Y ...) as memset,
+// copy loops (LDA ... / STA ... with the same index) as memcpy, and the classic 8 bit shift-and-add multiply.
+// They charge the cycles and leave the flags, registers and page crossing count the loop would have; loops that touch a hooked page
+// (I/O, bank registers) or their own code are left to the interpreter.
+// Called by skipIdleLoop with the loop it is watching: previous is the state one iteration earlier,
+// iteration_cycles what that iteration took. Returns the cycles run natively (never past end_cycles),
+// which the caller adds to cpu->cycles.
+long runLoopIdiom(CPU *cpu, int branch_address, const IdleLoopDetector *previous, long iteration_cycles, long long end_cycles);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,154 @@
+#include "idle.h"
+#include "idioms.h"
+#include "flags.h"
+
+// addressing modes of the instructions a polling loop may contain (none of them write memory or the stack)
+#define IDLE_NOT_ALLOWED 0
+#define IDLE_IMPLIED 1
+#define IDLE_IMMEDIATE 2
+#define IDLE_ZERO_PAGE 3
+#define IDLE_ZERO_PAGE_X 4
+#define IDLE_ZERO_PAGE_Y 5
+#define IDLE_ABSOLUTE 6
+#define IDLE_ABSOLUTE_X 7
+#define IDLE_ABSOLUTE_Y 8
+#define IDLE_RELATIVE 9
+
+// opcodes both variants implement the same way
+static const unsigned char idleModes[256] = {
+	[0xA9] = IDLE_IMMEDIATE, [0xA5] = IDLE_ZERO_PAGE, [0xB5] = IDLE_ZERO_PAGE_X, [0xAD] = IDLE_ABSOLUTE, [0xBD] = IDLE_ABSOLUTE_X, [0xB9] = IDLE_ABSOLUTE_Y, // LDA
+	[0xA2] = IDLE_IMMEDIATE, [0xA6] = IDLE_ZERO_PAGE, [0xB6] = IDLE_ZERO_PAGE_Y, [0xAE] = IDLE_ABSOLUTE, [0xBE] = IDLE_ABSOLUTE_Y, // LDX
+	[0xA0] = IDLE_IMMEDIATE, [0xA4] = IDLE_ZERO_PAGE, [0xB4] = IDLE_ZERO_PAGE_X, [0xAC] = IDLE_ABSOLUTE, [0xBC] = IDLE_ABSOLUTE_X, // LDY
+	[0xC9] = IDLE_IMMEDIATE, [0xC5] = IDLE_ZERO_PAGE, [0xD5] = IDLE_ZERO_PAGE_X, [0xCD] = IDLE_ABSOLUTE, [0xDD] = IDLE_ABSOLUTE_X, [0xD9] = IDLE_ABSOLUTE_Y, // CMP
+	[0xE0] = IDLE_IMMEDIATE, [0xE4] = IDLE_ZERO_PAGE, [0xEC] = IDLE_ABSOLUTE, // CPX
+	[0xC0] = IDLE_IMMEDIATE, [0xC4] = IDLE_ZERO_PAGE, [0xCC] = IDLE_ABSOLUTE, // CPY
+	[0x24] = IDLE_ZERO_PAGE, [0x2C] = IDLE_ABSOLUTE, // BIT
+	[0x29] = IDLE_IMMEDIATE, [0x25] = IDLE_ZERO_PAGE, [0x35] = IDLE_ZERO_PAGE_X, [0x2D] = IDLE_ABSOLUTE, [0x3D] = IDLE_ABSOLUTE_X, [0x39] = IDLE_ABSOLUTE_Y, // AND
+	[0x09] = IDLE_IMMEDIATE, [0x05] = IDLE_ZERO_PAGE, [0x15] = IDLE_ZERO_PAGE_X, [0x0D] = IDLE_ABSOLUTE, [0x1D] = IDLE_ABSOLUTE_X, [0x19] = IDLE_ABSOLUTE_Y, // ORA
+	[0x49] = IDLE_IMMEDIATE, [0x45] = IDLE_ZERO_PAGE, [0x55] = IDLE_ZERO_PAGE_X, [0x4D] = IDLE_ABSOLUTE, [0x5D] = IDLE_ABSOLUTE_X, [0x59] = IDLE_ABSOLUTE_Y, // EOR
+	[0x10] = IDLE_RELATIVE, [0x30] = IDLE_RELATIVE, [0x50] = IDLE_RELATIVE, [0x70] = IDLE_RELATIVE, // branches
+	[0x90] = IDLE_RELATIVE, [0xB0] = IDLE_RELATIVE, [0xD0] = IDLE_RELATIVE, [0xF0] = IDLE_RELATIVE,
+	[0xEA] = IDLE_IMPLIED, [0x18] = IDLE_IMPLIED, [0x38] = IDLE_IMPLIED, [0xB8] = IDLE_IMPLIED, // NOP, CLC, SEC, CLV
+	[0xAA] = IDLE_IMPLIED, [0xA8] = IDLE_IMPLIED, [0x8A] = IDLE_IMPLIED, [0x98] = IDLE_IMPLIED, // TAX, TAY, TXA, TYA
+};
+
+static int readsPlainMemory(CPU *cpu, int address) {
+	MemoryHook *hook = cpu->hooks[(address >> 0x8) & 0xFF];
+	return hook == NULL || hook->read == NULL;
+}
+
+// every instruction from loop_start up to the branch only reads plain memory, and inner branches stay in the loop
+static int isPollingLoop(CPU *cpu, int loop_start, int branch_address) {
+	int address = loop_start;
+	
+	while(address < branch_address) {
+		unsigned char opcode = *memoryByte(cpu, address);
+		unsigned char operand = *memoryByte(cpu, (address + 1) & 0xFFFF);
+		int absolute = operand | (*memoryByte(cpu, (address + 2) & 0xFFFF) << 0x8);
+		int operand_address = -1;
+		int length = 2;
+		
+		if(!readsPlainMemory(cpu, address)) {
+			return 0;
+		}
+		
+		switch(idleModes[opcode]) {
+			case IDLE_NOT_ALLOWED: return 0;
+			case IDLE_IMPLIED: length = 1; break;
+			case IDLE_IMMEDIATE: break;
+			case IDLE_ZERO_PAGE: operand_address = operand; break;
+			case IDLE_ZERO_PAGE_X: operand_address = (operand + cpu->x) & 0xFF; break;
+			case IDLE_ZERO_PAGE_Y: operand_address = (operand + cpu->y) & 0xFF; break;
+			case IDLE_ABSOLUTE: operand_address = absolute; length = 3; break;
+			case IDLE_ABSOLUTE_X: operand_address = (absolute + cpu->x) & 0xFFFF; length = 3; break;
+			case IDLE_ABSOLUTE_Y: operand_address = (absolute + cpu->y) & 0xFFFF; length = 3; break;
+			case IDLE_RELATIVE: {
+				int target = address + 2 + (signed char)operand;
+				if(target < loop_start || target > branch_address + 2) {
+					return 0;
+				}
+				break;
+			}
+		}
+		
+		if(operand_address >= 0 && !readsPlainMemory(cpu, operand_address)) {
+			return 0;
+		}
+		address += length;
+	}
+	
+	return address == branch_address;
+}
+
+static void watchLoop(IdleLoopDetector *detector, CPU *cpu, int branch_address) {
+	detector->loopStart = cpu->pc;
+	detector->branchAddress = branch_address;
+	detector->startCycles = cpu->cycles;
+	detector->startPageCrossings = cpu->pageCrossings;
+	detector->a = cpu->a;
+	detector->x = cpu->x;
+	detector->y = cpu->y;
+	detector->sp = cpu->sp;
+	detector->ps = cpu->ps;
+}
+
+void resetIdleLoopDetector(IdleLoopDetector *detector) {
+	detector->loopStart = -1;
+}
+
+long skipIdleLoop(IdleLoopDetector *detector, CPU *cpu, int branch_address, long long end_cycles) {
+	unsigned char opcode = *memoryByte(cpu, branch_address);
+	long skipped = 0;
+	
+	if(idleModes[opcode] != IDLE_RELATIVE) { // JMP, RTS... back: not a loop this handles
+		return 0;
+	}
+	
+	if(detector->loopStart != cpu->pc || detector->branchAddress != branch_address) {
+		watchLoop(detector, cpu, branch_address); // first time around, the next one measures an iteration
+		return 0;
+	}
+	
+	long iteration_cycles = cpu->cycles - detector->startCycles;
+	if(iteration_cycles <= 0) {
+		watchLoop(detector, cpu, branch_address);
+		return 0;
+	}
+	long iterations = (end_cycles - cpu->cycles) / iteration_cycles;
+	unsigned long iteration_page_crossings = cpu->pageCrossings - detector->startPageCrossings; // the same every iteration of these two
+	
+	if(cpu->a == detector->a && cpu->x == detector->x && cpu->y == detector->y && cpu->sp == detector->sp && cpu->ps == detector->ps) {
+		// nothing changed in a whole iteration: it polls until something outside the CPU changes memory
+		if(iterations > 0 && isPollingLoop(cpu, cpu->pc, branch_address)) {
+			skipped = iterations * iteration_cycles;
+			cpu->pageCrossings += iterations * iteration_page_crossings;
+		}
+	} else if(branch_address == cpu->pc + 1 && opcode == 0xD0 && cpu->a == detector->a && cpu->sp == detector->sp && (cpu->ps & 0x7D) == (detector->ps & 0x7D)) {
+		// DEX/DEY/INX/INY; BNE back: runs until the register wraps to zero
+		unsigned char counter_opcode = *memoryByte(cpu, cpu->pc);
+		int counts_x = (counter_opcode == 0xCA || counter_opcode == 0xE8);
+		int step = (counter_opcode == 0xCA || counter_opcode == 0x88 ? -1 : 1);
+		unsigned char *counter = (counts_x ? &cpu->x : &cpu->y);
+		unsigned char previous = (counts_x ? detector->x : detector->y);
+		int other_unchanged = (counts_x ? cpu->y == detector->y : cpu->x == detector->x);
+		
+		if((counts_x || counter_opcode == 0x88 || counter_opcode == 0xC8) && other_unchanged && *counter == (unsigned char)(previous + step)) {
+			long remaining = (step < 0 ? *counter : 0x100 - *counter) - 1; // taken iterations left, the last one falls through
+			if(iterations > remaining) {
+				iterations = remaining;
+			}
+			if(iterations > 0) {
+				*counter += step * iterations;
+				cpu->ps = (cpu->ps & 0x7D) | nzFlags[*counter];
+				skipped = iterations * iteration_cycles;
+				cpu->pageCrossings += iterations * iteration_page_crossings;
+			}
+		}
+	} else {
+		skipped = runLoopIdiom(cpu, branch_address, detector, iteration_cycles, end_cycles);
+	}
+	
+	cpu->cycles += skipped;
+	watchLoop(detector, cpu, branch_address);
+	return skipped;
+}
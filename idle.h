@@ -0,0 +1,32 @@
+#ifndef IDLE_H
+#define IDLE_H
+
+#include "cpu.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Spots guest loops that only spin (polling plain memory, or DEX/DEY/INX/INY + BNE delays) and moves cycles
+// forward over the iterations they would still run, in whole iterations, so the state, the cycle count and
+// the page crossing count end up the same as running them; loops that do work are handed to runLoopIdiom (idioms.h).
+// Run loops call skipIdleLoop after every instruction that jumped backwards.
+// Only safe when nothing outside the CPU watches or changes it while it spins: no instruction hook, no bus
+// callback, and no read hooks on the pages the loop reads (those are never skipped).
+typedef struct {
+	int loopStart; // -1 when no loop is being watched
+	int branchAddress;
+	long long startCycles;
+	unsigned long startPageCrossings;
+	unsigned char a, x, y, sp, ps;
+} IdleLoopDetector;
+
+void resetIdleLoopDetector(IdleLoopDetector *detector);
+// branch_address is the pc of the instruction that just ran; returns the cycles skipped (never past end_cycles)
+long skipIdleLoop(IdleLoopDetector *detector, CPU *cpu, int branch_address, long long end_cycles);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
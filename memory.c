@@ -0,0 +1,166 @@
+#ifdef __linux__
+#define _GNU_SOURCE // memfd_create
+#endif
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "memory.h"
+
+static unsigned char *pooledMemory(MemoryPool *pool, int index) {
+	return pool->ram + ((size_t)MEMORY_SIZE * index);
+}
+
+int initializeMemoryPool(MemoryPool *pool, int capacity) {
+	int i;
+	
+	pool->cpus = aligned_alloc(CACHE_LINE_SIZE, sizeof(CPU) * capacity); // sizeof(CPU) is a multiple of the alignment
+	pool->ram = mmap(NULL, (size_t)MEMORY_SIZE * capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0); // page aligned and zero filled
+	pool->freeList = malloc(sizeof(int) * capacity);
+	pool->fileBacked = calloc(capacity, 1);
+	pool->capacity = capacity;
+	pool->baseline = NULL;
+	pool->baselineFile = -1;
+	pool->resetMode = MEMORY_RESET_CLEAR;
+	
+	if(pool->ram == MAP_FAILED) {
+		pool->ram = NULL;
+	}
+	
+	if(pool->cpus == NULL || pool->ram == NULL || pool->freeList == NULL || pool->fileBacked == NULL) {
+		freeMemoryPool(pool);
+		return -1;
+	}
+	
+	for(i = 0; i < capacity; i++) {
+		pool->freeList[i] = capacity - 1 - i; // lowest index on top
+	}
+	pool->freeCount = capacity;
+	
+	return 0;
+}
+
+void freeMemoryPool(MemoryPool *pool) {
+	setMemoryPoolBaseline(pool, NULL);
+	if(pool->ram != NULL) {
+		munmap(pool->ram, (size_t)MEMORY_SIZE * pool->capacity);
+	}
+	free(pool->cpus);
+	free(pool->freeList);
+	free(pool->fileBacked);
+	pool->cpus = NULL;
+	pool->ram = NULL;
+	pool->freeList = NULL;
+	pool->fileBacked = NULL;
+	pool->freeCount = pool->capacity = 0;
+}
+
+void setMemoryPoolResetMode(MemoryPool *pool, int mode) {
+#ifdef __linux__
+	pool->resetMode = mode;
+#else
+	pool->resetMode = MEMORY_RESET_CLEAR;
+#endif
+}
+
+int setMemoryPoolBaseline(MemoryPool *pool, const unsigned char *image) {
+	free(pool->baseline);
+	pool->baseline = NULL;
+	if(pool->baselineFile != -1) {
+		close(pool->baselineFile);
+		pool->baselineFile = -1;
+	}
+	
+	if(image == NULL) {
+		return 0;
+	}
+	
+	pool->baseline = malloc(MEMORY_SIZE);
+	if(pool->baseline == NULL) {
+		return -1;
+	}
+	memcpy(pool->baseline, image, MEMORY_SIZE);
+	
+#ifdef __linux__
+	// one shared copy in the page cache, every CPU maps it privately
+	pool->baselineFile = memfd_create("6502-baseline", 0);
+	if(pool->baselineFile != -1 && write(pool->baselineFile, image, MEMORY_SIZE) != MEMORY_SIZE) {
+		close(pool->baselineFile);
+		pool->baselineFile = -1;
+	}
+#endif
+	
+	return 0;
+}
+
+// puts memory back to the baseline (or zeros)
+static void resetPooledMemory(MemoryPool *pool, int index) {
+	unsigned char *ram = pooledMemory(pool, index);
+	
+#ifdef __linux__
+	unsigned char *file_backed = &pool->fileBacked[index];
+	
+	if(pool->resetMode == MEMORY_RESET_REMAP) {
+		if(pool->baseline == NULL && *file_backed) {
+			// dropped pages of a block still mapping an old baseline would read back as that baseline, not zeros
+			if(mmap(ram, MEMORY_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) != MAP_FAILED) {
+				*file_backed = 0;
+				return;
+			}
+		} else if(pool->baseline == NULL) {
+			// anonymous private pages read back as zero once dropped, clean pages cost nothing
+			if(madvise(ram, MEMORY_SIZE, MADV_DONTNEED) == 0) {
+				return;
+			}
+		} else if(pool->baselineFile != -1) {
+			// replacing the mapping drops the dirty private copies, the rest is shared with the baseline file
+			if(mmap(ram, MEMORY_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, pool->baselineFile, 0) != MAP_FAILED) {
+				*file_backed = 1;
+				return;
+			}
+		}
+	}
+#endif
+	
+	if(pool->baseline != NULL) {
+		memcpy(ram, pool->baseline, MEMORY_SIZE);
+	} else {
+		memset(ram, 0, MEMORY_SIZE);
+	}
+}
+
+CPU *allocateCPU(MemoryPool *pool) {
+	if(pool->freeCount == 0) {
+		return NULL;
+	}
+	
+	CPU *cpu = &pool->cpus[pool->freeList[--pool->freeCount]];
+	resetPooledCPU(pool, cpu);
+	cpu->variant = CPU_NMOS; // callers pick another one after allocating
+	cpu->undocumentedOpcodes = 0;
+	cpu->jamOnUnknownOpcode = 0;
+	cpu->writeLog = NULL;
+#ifdef HEATMAP
+	cpu->heatmap = NULL;
+#endif
+#ifdef COVERAGE
+	cpu->coverage = NULL;
+#endif
+#ifdef CYCLE_EXACT
+	cpu->busCallback = NULL;
+#endif
+	
+	return cpu;
+}
+
+void resetPooledCPU(MemoryPool *pool, CPU *cpu) {
+	int index = (int)(cpu - pool->cpus);
+	
+	resetPooledMemory(pool, index);
+	initializeMemory(cpu, pooledMemory(pool, index));
+	resetCPU(cpu);
+}
+
+void releaseCPU(MemoryPool *pool, CPU *cpu) {
+	pool->freeList[pool->freeCount++] = (int)(cpu - pool->cpus);
+}
@@ -0,0 +1,46 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include "cpu.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// how pooled memory is restored when a CPU is allocated or reset
+#define MEMORY_RESET_CLEAR 0 // memset (or memcpy of the baseline image), touches all MEMORY_SIZE bytes (default, cheapest for a plain 64 KiB)
+#define MEMORY_RESET_REMAP 1 // drops the dirty pages so they read back as zero (or as the baseline image); Linux only, others fall back to MEMORY_RESET_CLEAR
+
+// Pool of CPU instances for hosts that create and destroy lots of them.
+// All CPUs and their memory come from allocations made up front, so allocating or resetting a CPU
+// costs one clear of its memory (or, with MEMORY_RESET_REMAP, about one page fault per page it dirtied).
+typedef struct {
+	CPU *cpus;
+	unsigned char *ram; // capacity * MEMORY_SIZE bytes mapped at once, one block per CPU
+	int *freeList; // indexes of the free CPUs, used as a stack
+	int freeCount;
+	int capacity;
+	
+	int resetMode;
+	unsigned char *baseline; // image every CPU starts from (NULL for all zeros)
+	int baselineFile; // shared copy of baseline that MEMORY_RESET_REMAP maps copy-on-write, -1 if none
+	unsigned char *fileBacked; // per block, non zero while it maps a baseline file instead of anonymous memory
+} MemoryPool;
+
+int initializeMemoryPool(MemoryPool *pool, int capacity); // returns -1 if it can't allocate
+void freeMemoryPool(MemoryPool *pool);
+
+void setMemoryPoolResetMode(MemoryPool *pool, int mode);
+// every CPU allocated or reset from now on starts with a copy of image (MEMORY_SIZE bytes), NULL goes back to zeros; returns -1 on failure
+int setMemoryPoolBaseline(MemoryPool *pool, const unsigned char *image);
+
+// returns a CPU with fresh memory and registers reset, or NULL when every CPU in the pool is in use
+CPU *allocateCPU(MemoryPool *pool);
+void resetPooledCPU(MemoryPool *pool, CPU *cpu); // memory back to the baseline and registers to their power on values
+void releaseCPU(MemoryPool *pool, CPU *cpu); // instead of freeCPU for CPUs from the pool
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
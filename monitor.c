@@ -0,0 +1,62 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "counters.h"
+
+// Prints the live counters of a running emulator or server once a second: ./6502_monitor name [seconds]
+// MHz is guest cycles per second of host time since the previous line; skipped is the share of cycles
+// covered by idle loop skipping and host-code idioms.
+
+#define MONITOR_MAX_SLOTS 256
+
+static void printSlot(int slot, const CounterValues *now, const CounterValues *before) {
+	double seconds = (now->updated - before->updated) / 1e9;
+	double megahertz = (seconds > 0 ? (now->cycles - before->cycles) / seconds / 1e6 : 0);
+	double skipped = (now->cycles > 0 ? 100.0 * now->skippedCycles / now->cycles : 0);
+
+	printf("%4i %14lu %14lu %9.2f %7.1f%% %12lu %7lu %7lu %10lu\n", slot, now->instructions, now->cycles, megahertz, skipped,
+		now->pageCrossings, now->faults, now->interrupts, now->runs);
+}
+
+int main(int argc, char *argv[]) {
+	CounterValues before[MONITOR_MAX_SLOTS] = { { 0 } };
+	CounterValues now;
+	int seconds = 1;
+	int i;
+
+	if(argc < 2 || argc > 3) {
+		printf("Usage: %s counters [seconds]\n", argv[0]);
+		return -1;
+	}
+	if(argc == 3 && (seconds = atoi(argv[2])) < 1) {
+		seconds = 1;
+	}
+
+	CounterSegment *segment = openCounterSegment(argv[1]);
+	if(segment == NULL) {
+		printf("Can't open counters %s.\n", argv[1]);
+		return -1;
+	}
+	int slots = counterSlotCount(segment);
+	if(slots > MONITOR_MAX_SLOTS) {
+		slots = MONITOR_MAX_SLOTS;
+	}
+
+	for(i = 0; i < slots; i++) {
+		readCounters(segment, i, &before[i]);
+	}
+	for(;;) {
+		sleep(seconds);
+		printf("slot   instructions         cycles       MHz skipped  page-cross  faults    irqs       runs\n");
+		for(i = 0; i < slots; i++) {
+			readCounters(segment, i, &now);
+			printSlot(i, &now, &before[i]);
+			if(now.updated != before[i].updated) { // MHz over the last interval that had an update
+				before[i] = now;
+			}
+		}
+		fflush(stdout);
+	}
+
+	return 0;
+}
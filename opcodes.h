@@ -0,0 +1,215 @@
+// Opcodes shared by the NMOS 6502 and the 65C02, expanded into the instruction shapes of core.h inside the switch of
+// each step function in cpu.c (together with opcodes_nmos.h or opcodes_65c02.h); flow.c and recompile.c expand the
+// same tables to decode and recompile them.
+// Every documented opcode is one line: the instruction shape (see core.h), the operation, the addressing mode and the base cycles.
+// Page crossing penalties are added by the addressing mode.
+
+// ADC
+READ(0x69, addWithCarry, Immediate, 2)
+READ(0x65, addWithCarry, ZeroPage, 3)
+READ(0x75, addWithCarry, ZeroPageX, 4)
+READ(0x6D, addWithCarry, Absolute, 4)
+READ(0x7D, addWithCarry, AbsoluteX, 4)
+READ(0x79, addWithCarry, AbsoluteY, 4)
+READ(0x61, addWithCarry, IndexedIndirect, 6)
+READ(0x71, addWithCarry, IndirectIndexed, 5)
+
+// AND
+READ(0x29, andWithAccumulator, Immediate, 2)
+READ(0x25, andWithAccumulator, ZeroPage, 3)
+READ(0x35, andWithAccumulator, ZeroPageX, 4)
+READ(0x2D, andWithAccumulator, Absolute, 4)
+READ(0x3D, andWithAccumulator, AbsoluteX, 4)
+READ(0x39, andWithAccumulator, AbsoluteY, 4)
+READ(0x21, andWithAccumulator, IndexedIndirect, 6)
+READ(0x31, andWithAccumulator, IndirectIndexed, 5)
+
+// ASL (abs,X in opcodes_nmos.h and opcodes_65c02.h)
+MODIFY_ACCUMULATOR(0x0A, arithmeticShiftLeft, 2)
+MODIFY(0x06, arithmeticShiftLeft, ZeroPage, 5)
+MODIFY(0x16, arithmeticShiftLeft, ZeroPageX, 6)
+MODIFY(0x0E, arithmeticShiftLeft, Absolute, 6)
+
+// branches
+BRANCH(0x10, (cpu->ps & 0x80) == 0) // BPL: if bit 7 is off
+BRANCH(0x30, (cpu->ps & 0x80) != 0) // BMI: if bit 7 is on
+BRANCH(0x50, (cpu->ps & 0x40) == 0) // BVC: if bit 6 is off
+BRANCH(0x70, (cpu->ps & 0x40) != 0) // BVS: if bit 6 is on
+BRANCH(0x90, (cpu->ps & 0x1) == 0) // BCC: if bit 0 is off
+BRANCH(0xB0, (cpu->ps & 0x1) != 0) // BCS: if bit 0 is on
+BRANCH(0xD0, (cpu->ps & 0x2) == 0) // BNE: if bit 1 is off
+BRANCH(0xF0, (cpu->ps & 0x2) != 0) // BEQ: if bit 1 is on
+
+// BIT
+READ(0x24, testByte, ZeroPage, 3)
+READ(0x2C, testByte, Absolute, 4)
+
+// BRK
+CONTROL(0x00, forceBreak, 7)
+
+// flags
+IMPLIED(0x18, clearCarry, 2) // CLC
+IMPLIED(0x38, setCarry, 2) // SEC
+IMPLIED(0x58, clearInterruptDisable, 2) // CLI
+IMPLIED(0x78, setInterruptDisable, 2) // SEI
+IMPLIED(0xB8, clearOverflow, 2) // CLV
+IMPLIED(0xD8, clearDecimal, 2) // CLD
+IMPLIED(0xF8, setDecimal, 2) // SED
+
+// CMP
+READ(0xC9, compareWithAccumulator, Immediate, 2)
+READ(0xC5, compareWithAccumulator, ZeroPage, 3)
+READ(0xD5, compareWithAccumulator, ZeroPageX, 4)
+READ(0xCD, compareWithAccumulator, Absolute, 4)
+READ(0xDD, compareWithAccumulator, AbsoluteX, 4)
+READ(0xD9, compareWithAccumulator, AbsoluteY, 4)
+READ(0xC1, compareWithAccumulator, IndexedIndirect, 6)
+READ(0xD1, compareWithAccumulator, IndirectIndexed, 5)
+
+// CPX
+READ(0xE0, compareWithX, Immediate, 2)
+READ(0xE4, compareWithX, ZeroPage, 3)
+READ(0xEC, compareWithX, Absolute, 4)
+
+// CPY
+READ(0xC0, compareWithY, Immediate, 2)
+READ(0xC4, compareWithY, ZeroPage, 3)
+READ(0xCC, compareWithY, Absolute, 4)
+
+// DEC
+MODIFY(0xC6, decrementByte, ZeroPage, 5)
+MODIFY(0xD6, decrementByte, ZeroPageX, 6)
+MODIFY(0xCE, decrementByte, Absolute, 6)
+MODIFY(0xDE, decrementByte, AbsoluteX, 7)
+
+// DEX, DEY
+IMPLIED(0xCA, decrementX, 2)
+IMPLIED(0x88, decrementY, 2)
+
+// EOR
+READ(0x49, exclusiveOrWithAccumulator, Immediate, 2)
+READ(0x45, exclusiveOrWithAccumulator, ZeroPage, 3)
+READ(0x55, exclusiveOrWithAccumulator, ZeroPageX, 4)
+READ(0x4D, exclusiveOrWithAccumulator, Absolute, 4)
+READ(0x5D, exclusiveOrWithAccumulator, AbsoluteX, 4)
+READ(0x59, exclusiveOrWithAccumulator, AbsoluteY, 4)
+READ(0x41, exclusiveOrWithAccumulator, IndexedIndirect, 6)
+READ(0x51, exclusiveOrWithAccumulator, IndirectIndexed, 5)
+
+// INC
+MODIFY(0xE6, incrementByte, ZeroPage, 5)
+MODIFY(0xF6, incrementByte, ZeroPageX, 6)
+MODIFY(0xEE, incrementByte, Absolute, 6)
+MODIFY(0xFE, incrementByte, AbsoluteX, 7)
+
+// INX, INY
+IMPLIED(0xE8, incrementX, 2)
+IMPLIED(0xC8, incrementY, 2)
+
+// JMP (indirect is in the variant tables)
+CONTROL(0x4C, jumpAbsolute, 3)
+
+// JSR
+CONTROL(0x20, jumpToSubroutine, 6)
+
+// LDA
+READ(0xA9, loadAccumulator, Immediate, 2)
+READ(0xA5, loadAccumulator, ZeroPage, 3)
+READ(0xB5, loadAccumulator, ZeroPageX, 4)
+READ(0xAD, loadAccumulator, Absolute, 4)
+READ(0xBD, loadAccumulator, AbsoluteX, 4)
+READ(0xB9, loadAccumulator, AbsoluteY, 4)
+READ(0xA1, loadAccumulator, IndexedIndirect, 6)
+READ(0xB1, loadAccumulator, IndirectIndexed, 5)
+
+// LDX
+READ(0xA2, loadX, Immediate, 2)
+READ(0xA6, loadX, ZeroPage, 3)
+READ(0xB6, loadX, ZeroPageY, 4)
+READ(0xAE, loadX, Absolute, 4)
+READ(0xBE, loadX, AbsoluteY, 4)
+
+// LDY
+READ(0xA0, loadY, Immediate, 2)
+READ(0xA4, loadY, ZeroPage, 3)
+READ(0xB4, loadY, ZeroPageX, 4)
+READ(0xAC, loadY, Absolute, 4)
+READ(0xBC, loadY, AbsoluteX, 4)
+
+// LSR (abs,X in opcodes_nmos.h and opcodes_65c02.h)
+MODIFY_ACCUMULATOR(0x4A, logicalShiftRight, 2)
+MODIFY(0x46, logicalShiftRight, ZeroPage, 5)
+MODIFY(0x56, logicalShiftRight, ZeroPageX, 6)
+MODIFY(0x4E, logicalShiftRight, Absolute, 6)
+
+// NOP
+IMPLIED(0xEA, noOperation, 2)
+
+// ORA
+READ(0x09, orWithAccumulator, Immediate, 2)
+READ(0x05, orWithAccumulator, ZeroPage, 3)
+READ(0x15, orWithAccumulator, ZeroPageX, 4)
+READ(0x0D, orWithAccumulator, Absolute, 4)
+READ(0x1D, orWithAccumulator, AbsoluteX, 4)
+READ(0x19, orWithAccumulator, AbsoluteY, 4)
+READ(0x01, orWithAccumulator, IndexedIndirect, 6)
+READ(0x11, orWithAccumulator, IndirectIndexed, 5)
+
+// stack
+IMPLIED(0x48, pushAccumulator, 3) // PHA
+IMPLIED(0x08, pushStatus, 3) // PHP
+IMPLIED(0x68, pullAccumulator, 4) // PLA
+IMPLIED(0x28, pullStatus, 4) // PLP
+
+// ROL (abs,X in opcodes_nmos.h and opcodes_65c02.h)
+MODIFY_ACCUMULATOR(0x2A, rotateLeft, 2)
+MODIFY(0x26, rotateLeft, ZeroPage, 5)
+MODIFY(0x36, rotateLeft, ZeroPageX, 6)
+MODIFY(0x2E, rotateLeft, Absolute, 6)
+
+// ROR (abs,X in opcodes_nmos.h and opcodes_65c02.h)
+MODIFY_ACCUMULATOR(0x6A, rotateRight, 2)
+MODIFY(0x66, rotateRight, ZeroPage, 5)
+MODIFY(0x76, rotateRight, ZeroPageX, 6)
+MODIFY(0x6E, rotateRight, Absolute, 6)
+
+// RTI, RTS
+IMPLIED(0x40, returnFromInterrupt, 6)
+IMPLIED(0x60, returnFromSubroutine, 6)
+
+// SBC
+READ(0xE9, subtractWithCarry, Immediate, 2)
+READ(0xE5, subtractWithCarry, ZeroPage, 3)
+READ(0xF5, subtractWithCarry, ZeroPageX, 4)
+READ(0xED, subtractWithCarry, Absolute, 4)
+READ(0xFD, subtractWithCarry, AbsoluteX, 4)
+READ(0xF9, subtractWithCarry, AbsoluteY, 4)
+READ(0xE1, subtractWithCarry, IndexedIndirect, 6)
+READ(0xF1, subtractWithCarry, IndirectIndexed, 5)
+
+// STA
+WRITE(0x85, storeAccumulator, ZeroPage, 3)
+WRITE(0x95, storeAccumulator, ZeroPageX, 4)
+WRITE(0x8D, storeAccumulator, Absolute, 4)
+WRITE(0x9D, storeAccumulator, AbsoluteX, 5)
+WRITE(0x99, storeAccumulator, AbsoluteY, 5)
+WRITE(0x81, storeAccumulator, IndexedIndirect, 6)
+WRITE(0x91, storeAccumulator, IndirectIndexed, 6)
+
+// STX
+WRITE(0x86, storeX, ZeroPage, 3)
+WRITE(0x96, storeX, ZeroPageY, 4)
+WRITE(0x8E, storeX, Absolute, 4)
+
+// STY
+WRITE(0x84, storeY, ZeroPage, 3)
+WRITE(0x94, storeY, ZeroPageX, 4)
+WRITE(0x8C, storeY, Absolute, 4)
+
+// transfers
+IMPLIED(0xAA, transferAccumulatorToX, 2) // TAX
+IMPLIED(0xA8, transferAccumulatorToY, 2) // TAY
+IMPLIED(0xBA, transferStackPointerToX, 2) // TSX
+IMPLIED(0x8A, transferXToAccumulator, 2) // TXA
+IMPLIED(0x9A, transferXToStackPointer, 2) // TXS
+IMPLIED(0x98, transferYToAccumulator, 2) // TYA
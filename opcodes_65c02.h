@@ -0,0 +1,53 @@
+// 65C02 additions and fixes, expanded inside the switch in step65C02().
+// Shapes shared with the NMOS table keep its bus accesses, so the cycle counts match the 65C02 but CYCLE_EXACT
+// bus traces of read-modify-write instructions still show the NMOS dummy write (all but the MODIFY_PAGED ones).
+
+// (zpg) addressing
+READ(0x72, addWithCarry, ZeroPageIndirect, 5) // ADC
+READ(0x32, andWithAccumulator, ZeroPageIndirect, 5) // AND
+READ(0xD2, compareWithAccumulator, ZeroPageIndirect, 5) // CMP
+READ(0x52, exclusiveOrWithAccumulator, ZeroPageIndirect, 5) // EOR
+READ(0xB2, loadAccumulator, ZeroPageIndirect, 5) // LDA
+READ(0x12, orWithAccumulator, ZeroPageIndirect, 5) // ORA
+READ(0xF2, subtractWithCarry, ZeroPageIndirect, 5) // SBC
+WRITE(0x92, storeAccumulator, ZeroPageIndirect, 5) // STA
+
+// BIT
+READ(0x89, testByteImmediate, Immediate, 2)
+READ(0x34, testByte, ZeroPageX, 4)
+READ(0x3C, testByte, AbsoluteX, 4)
+
+// ASL, LSR, ROL, ROR abs,X: 6 cycles, 7 when indexing crosses a page
+MODIFY_PAGED(0x1E, arithmeticShiftLeft, AbsoluteX, 6)
+MODIFY_PAGED(0x5E, logicalShiftRight, AbsoluteX, 6)
+MODIFY_PAGED(0x3E, rotateLeft, AbsoluteX, 6)
+MODIFY_PAGED(0x7E, rotateRight, AbsoluteX, 6)
+
+// BRA
+BRANCH(0x80, 1)
+
+// INC A, DEC A
+MODIFY_ACCUMULATOR(0x1A, incrementByte, 2)
+MODIFY_ACCUMULATOR(0x3A, decrementByte, 2)
+
+// JMP
+CONTROL(0x6C, jumpIndirectFixed, 6)
+CONTROL(0x7C, jumpIndexedIndirect, 6)
+
+// PHX, PHY, PLX, PLY
+IMPLIED(0xDA, pushX, 3)
+IMPLIED(0x5A, pushY, 3)
+IMPLIED(0xFA, pullX, 4)
+IMPLIED(0x7A, pullY, 4)
+
+// STZ
+WRITE(0x64, storeZero, ZeroPage, 3)
+WRITE(0x74, storeZero, ZeroPageX, 4)
+WRITE(0x9C, storeZero, Absolute, 4)
+WRITE(0x9E, storeZero, AbsoluteX, 5)
+
+// TRB, TSB
+MODIFY(0x14, testAndResetBits, ZeroPage, 5)
+MODIFY(0x1C, testAndResetBits, Absolute, 6)
+MODIFY(0x04, testAndSetBits, ZeroPage, 5)
+MODIFY(0x0C, testAndSetBits, Absolute, 6)
@@ -0,0 +1,10 @@
+// Opcodes the NMOS 6502 does differently from the 65C02, expanded inside the switch in stepNMOS().
+
+// JMP (indirect), with the page wrap bug
+CONTROL(0x6C, jumpIndirect, 5)
+
+// ASL, LSR, ROL, ROR abs,X always spend the indexing cycle
+MODIFY(0x1E, arithmeticShiftLeft, AbsoluteX, 7)
+MODIFY(0x5E, logicalShiftRight, AbsoluteX, 7)
+MODIFY(0x3E, rotateLeft, AbsoluteX, 7)
+MODIFY(0x7E, rotateRight, AbsoluteX, 7)
@@ -0,0 +1,110 @@
+// Stable undocumented NMOS 6502 opcodes, expanded inside the switch in stepUndocumented().
+// Cycle counts are the ones of the documented instructions they are made of; the unstable ones
+// (XAA, LXA, LAS, SHA, SHX, SHY, TAS) and the JAMs are left out and still crash.
+
+// ALR, ANC, ARR, SBX (immediate only)
+READ(0x4B, andAndShiftRight, Immediate, 2)
+READ(0x0B, andWithCarry, Immediate, 2)
+READ(0x2B, andWithCarry, Immediate, 2)
+READ(0x6B, andAndRotateRight, Immediate, 2)
+READ(0xCB, subtractFromAccumulatorAndX, Immediate, 2)
+
+// DCP
+MODIFY(0xC7, decrementAndCompare, ZeroPage, 5)
+MODIFY(0xD7, decrementAndCompare, ZeroPageX, 6)
+MODIFY(0xCF, decrementAndCompare, Absolute, 6)
+MODIFY(0xDF, decrementAndCompare, AbsoluteX, 7)
+MODIFY(0xDB, decrementAndCompare, AbsoluteY, 7)
+MODIFY(0xC3, decrementAndCompare, IndexedIndirect, 8)
+MODIFY(0xD3, decrementAndCompare, IndirectIndexed, 8)
+
+// ISC
+MODIFY(0xE7, incrementAndSubtract, ZeroPage, 5)
+MODIFY(0xF7, incrementAndSubtract, ZeroPageX, 6)
+MODIFY(0xEF, incrementAndSubtract, Absolute, 6)
+MODIFY(0xFF, incrementAndSubtract, AbsoluteX, 7)
+MODIFY(0xFB, incrementAndSubtract, AbsoluteY, 7)
+MODIFY(0xE3, incrementAndSubtract, IndexedIndirect, 8)
+MODIFY(0xF3, incrementAndSubtract, IndirectIndexed, 8)
+
+// LAX
+READ(0xA7, loadAccumulatorAndX, ZeroPage, 3)
+READ(0xB7, loadAccumulatorAndX, ZeroPageY, 4)
+READ(0xAF, loadAccumulatorAndX, Absolute, 4)
+READ(0xBF, loadAccumulatorAndX, AbsoluteY, 4)
+READ(0xA3, loadAccumulatorAndX, IndexedIndirect, 6)
+READ(0xB3, loadAccumulatorAndX, IndirectIndexed, 5)
+
+// NOP (implied, and the ones that read an operand they ignore)
+IMPLIED(0x1A, noOperation, 2)
+IMPLIED(0x3A, noOperation, 2)
+IMPLIED(0x5A, noOperation, 2)
+IMPLIED(0x7A, noOperation, 2)
+IMPLIED(0xDA, noOperation, 2)
+IMPLIED(0xFA, noOperation, 2)
+READ(0x80, ignoreOperand, Immediate, 2)
+READ(0x82, ignoreOperand, Immediate, 2)
+READ(0x89, ignoreOperand, Immediate, 2)
+READ(0xC2, ignoreOperand, Immediate, 2)
+READ(0xE2, ignoreOperand, Immediate, 2)
+READ(0x04, ignoreOperand, ZeroPage, 3)
+READ(0x44, ignoreOperand, ZeroPage, 3)
+READ(0x64, ignoreOperand, ZeroPage, 3)
+READ(0x14, ignoreOperand, ZeroPageX, 4)
+READ(0x34, ignoreOperand, ZeroPageX, 4)
+READ(0x54, ignoreOperand, ZeroPageX, 4)
+READ(0x74, ignoreOperand, ZeroPageX, 4)
+READ(0xD4, ignoreOperand, ZeroPageX, 4)
+READ(0xF4, ignoreOperand, ZeroPageX, 4)
+READ(0x0C, ignoreOperand, Absolute, 4)
+READ(0x1C, ignoreOperand, AbsoluteX, 4)
+READ(0x3C, ignoreOperand, AbsoluteX, 4)
+READ(0x5C, ignoreOperand, AbsoluteX, 4)
+READ(0x7C, ignoreOperand, AbsoluteX, 4)
+READ(0xDC, ignoreOperand, AbsoluteX, 4)
+READ(0xFC, ignoreOperand, AbsoluteX, 4)
+
+// RLA
+MODIFY(0x27, rotateLeftAndAnd, ZeroPage, 5)
+MODIFY(0x37, rotateLeftAndAnd, ZeroPageX, 6)
+MODIFY(0x2F, rotateLeftAndAnd, Absolute, 6)
+MODIFY(0x3F, rotateLeftAndAnd, AbsoluteX, 7)
+MODIFY(0x3B, rotateLeftAndAnd, AbsoluteY, 7)
+MODIFY(0x23, rotateLeftAndAnd, IndexedIndirect, 8)
+MODIFY(0x33, rotateLeftAndAnd, IndirectIndexed, 8)
+
+// RRA
+MODIFY(0x67, rotateRightAndAdd, ZeroPage, 5)
+MODIFY(0x77, rotateRightAndAdd, ZeroPageX, 6)
+MODIFY(0x6F, rotateRightAndAdd, Absolute, 6)
+MODIFY(0x7F, rotateRightAndAdd, AbsoluteX, 7)
+MODIFY(0x7B, rotateRightAndAdd, AbsoluteY, 7)
+MODIFY(0x63, rotateRightAndAdd, IndexedIndirect, 8)
+MODIFY(0x73, rotateRightAndAdd, IndirectIndexed, 8)
+
+// SAX
+WRITE(0x87, storeAccumulatorAndX, ZeroPage, 3)
+WRITE(0x97, storeAccumulatorAndX, ZeroPageY, 4)
+WRITE(0x8F, storeAccumulatorAndX, Absolute, 4)
+WRITE(0x83, storeAccumulatorAndX, IndexedIndirect, 6)
+
+// SBC (same as 0xE9)
+READ(0xEB, subtractWithCarry, Immediate, 2)
+
+// SLO
+MODIFY(0x07, shiftLeftAndOr, ZeroPage, 5)
+MODIFY(0x17, shiftLeftAndOr, ZeroPageX, 6)
+MODIFY(0x0F, shiftLeftAndOr, Absolute, 6)
+MODIFY(0x1F, shiftLeftAndOr, AbsoluteX, 7)
+MODIFY(0x1B, shiftLeftAndOr, AbsoluteY, 7)
+MODIFY(0x03, shiftLeftAndOr, IndexedIndirect, 8)
+MODIFY(0x13, shiftLeftAndOr, IndirectIndexed, 8)
+
+// SRE
+MODIFY(0x47, shiftRightAndExclusiveOr, ZeroPage, 5)
+MODIFY(0x57, shiftRightAndExclusiveOr, ZeroPageX, 6)
+MODIFY(0x4F, shiftRightAndExclusiveOr, Absolute, 6)
+MODIFY(0x5F, shiftRightAndExclusiveOr, AbsoluteX, 7)
+MODIFY(0x5B, shiftRightAndExclusiveOr, AbsoluteY, 7)
+MODIFY(0x43, shiftRightAndExclusiveOr, IndexedIndirect, 8)
+MODIFY(0x53, shiftRightAndExclusiveOr, IndirectIndexed, 8)
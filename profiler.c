@@ -0,0 +1,260 @@
+#include <string.h>
+#include "profiler.h"
+
+#define PROFILER_MAX_DEPTH 64 // frames per stack, innermost kept
+#define PROFILER_INITIAL_STACKS 1024 // power of two
+#define PROFILER_NAME_LENGTH 64
+
+#define OPCODE_JSR 0x20
+
+typedef struct {
+	long count; // 0 for a free slot
+	unsigned int hash;
+	int depth;
+	unsigned short frames[PROFILER_MAX_DEPTH]; // outermost first
+} Stack;
+
+typedef struct {
+	int address;
+	char *name;
+} Label;
+
+struct Profiler {
+	long interval;
+	long long nextSample;
+	long samples;
+	
+	Stack *stacks; // open addressing on hash
+	int stackCapacity;
+	int stackCount;
+	
+	Label *labels; // sorted by address
+	int labelCount;
+};
+
+Profiler *createProfiler(long interval) {
+	Profiler *profiler;
+	
+	if(interval <= 0 || (profiler = calloc(1, sizeof(Profiler))) == NULL) {
+		return NULL;
+	}
+	profiler->interval = interval;
+	profiler->nextSample = interval;
+	profiler->stackCapacity = PROFILER_INITIAL_STACKS;
+	profiler->stacks = calloc(profiler->stackCapacity, sizeof(Stack));
+	if(profiler->stacks == NULL) {
+		free(profiler);
+		return NULL;
+	}
+	return profiler;
+}
+
+void freeProfiler(Profiler *profiler) {
+	int i;
+	
+	if(profiler == NULL) {
+		return;
+	}
+	for(i = 0; i < profiler->labelCount; i++) {
+		free(profiler->labels[i].name);
+	}
+	free(profiler->labels);
+	free(profiler->stacks);
+	free(profiler);
+}
+
+static int compareLabels(const void *first, const void *second) {
+	return ((const Label *)first)->address - ((const Label *)second)->address;
+}
+
+// address and name of one label map line, 0 if it isn't one
+static int parseLabel(const char *line, int *address, char *name) {
+	char address_text[PROFILER_NAME_LENGTH];
+	char *colon;
+	
+	if(sscanf(line, " al %63s %63s", address_text, name) == 2) { // al C:4000 .name, or al 004000 .name
+		colon = strchr(address_text, ':');
+		if(name[0] == '.') {
+			memmove(name, name + 1, strlen(name));
+		}
+		return sscanf(colon != NULL ? colon + 1 : address_text, "%x", address) == 1;
+	}
+	if(sscanf(line, " %63[A-Za-z0-9_@.] = $%x", name, address) == 2) {
+		return 1;
+	}
+	return sscanf(line, " %x %63s", address, name) == 2;
+}
+
+int loadProfilerLabels(Profiler *profiler, FILE *file) {
+	char line[256];
+	char name[PROFILER_NAME_LENGTH];
+	int address;
+	int loaded = 0;
+	
+	while(fgets(line, sizeof(line), file) != NULL) {
+		if(!parseLabel(line, &address, name) || address < 0 || address >= MEMORY_SIZE || name[0] == '\0') {
+			continue;
+		}
+		Label *labels = realloc(profiler->labels, sizeof(Label) * (profiler->labelCount + 1));
+		if(labels == NULL) {
+			return -1;
+		}
+		profiler->labels = labels;
+		labels[profiler->labelCount].address = address;
+		labels[profiler->labelCount].name = strdup(name);
+		if(labels[profiler->labelCount].name == NULL) {
+			return -1;
+		}
+		profiler->labelCount++;
+		loaded++;
+	}
+	
+	qsort(profiler->labels, profiler->labelCount, sizeof(Label), compareLabels);
+	return loaded;
+}
+
+// the nearest label at or below address, NULL if there is none
+static const Label *labelFor(Profiler *profiler, int address) {
+	int low = 0, high = profiler->labelCount - 1;
+	const Label *found = NULL;
+	
+	while(low <= high) {
+		int middle = (low + high) / 2;
+		if(profiler->labels[middle].address <= address) {
+			found = &profiler->labels[middle];
+			low = middle + 1;
+		} else {
+			high = middle - 1;
+		}
+	}
+	return found;
+}
+
+// frames are stored as the address of their label, so samples anywhere in a routine fold into one stack
+static unsigned short frameFor(Profiler *profiler, int address) {
+	const Label *label = labelFor(profiler, address);
+	return (label != NULL ? label->address : address);
+}
+
+static unsigned int hashStack(const Stack *stack) {
+	unsigned int hash = 2166136261u; // FNV-1a
+	int i;
+	
+	for(i = 0; i < stack->depth; i++) {
+		hash = (hash ^ stack->frames[i]) * 16777619u;
+	}
+	return hash;
+}
+
+static Stack *findStack(Stack *stacks, int capacity, const Stack *stack) {
+	int i = stack->hash & (capacity - 1);
+	
+	while(stacks[i].count != 0 && (stacks[i].hash != stack->hash || stacks[i].depth != stack->depth ||
+		memcmp(stacks[i].frames, stack->frames, sizeof(stack->frames[0]) * stack->depth) != 0)) {
+		i = (i + 1) & (capacity - 1);
+	}
+	return &stacks[i];
+}
+
+static int growStacks(Profiler *profiler) {
+	int capacity = profiler->stackCapacity * 2;
+	Stack *stacks = calloc(capacity, sizeof(Stack));
+	int i;
+	
+	if(stacks == NULL) {
+		return -1;
+	}
+	for(i = 0; i < profiler->stackCapacity; i++) {
+		if(profiler->stacks[i].count != 0) {
+			*findStack(stacks, capacity, &profiler->stacks[i]) = profiler->stacks[i];
+		}
+	}
+	free(profiler->stacks);
+	profiler->stacks = stacks;
+	profiler->stackCapacity = capacity;
+	return 0;
+}
+
+void startProfiler(Profiler *profiler, long long cycles) {
+	profiler->nextSample = cycles + profiler->interval;
+}
+
+long long nextProfilerSample(Profiler *profiler) {
+	return profiler->nextSample;
+}
+
+void sampleProfiler(Profiler *profiler, CPU *cpu) {
+	unsigned short callers[PROFILER_MAX_DEPTH]; // call sites, innermost first
+	int caller_count = 0;
+	int offset = cpu->sp + 1;
+	long weight = 1;
+	Stack stack;
+	int i;
+	
+	if(cpu->cycles >= profiler->nextSample) {
+		weight += (cpu->cycles - profiler->nextSample) / profiler->interval;
+		profiler->nextSample += weight * profiler->interval;
+	}
+	
+	while(offset < 0xFF && caller_count < PROFILER_MAX_DEPTH - 1) {
+		int return_address = *memoryByte(cpu, 0x100 + offset) | (*memoryByte(cpu, 0x100 + offset + 1) << 0x8);
+		int call = (return_address - 2) & 0xFFFF; // JSR pushes the address of its own last byte
+		if(*memoryByte(cpu, call) == OPCODE_JSR) {
+			callers[caller_count++] = call;
+			offset += 2;
+		} else {
+			offset++;
+		}
+	}
+	
+	stack.count = 0;
+	stack.depth = caller_count + 1;
+	for(i = 0; i < caller_count; i++) {
+		stack.frames[i] = frameFor(profiler, callers[caller_count - 1 - i]);
+	}
+	stack.frames[caller_count] = frameFor(profiler, cpu->pc);
+	stack.hash = hashStack(&stack);
+	
+	if(profiler->stackCount * 4 >= profiler->stackCapacity * 3 && growStacks(profiler) < 0) {
+		return; // out of memory, the sample is lost
+	}
+	Stack *slot = findStack(profiler->stacks, profiler->stackCapacity, &stack);
+	if(slot->count == 0) {
+		*slot = stack;
+		profiler->stackCount++;
+	}
+	slot->count += weight;
+	profiler->samples += weight;
+}
+
+static void writeFrame(Profiler *profiler, FILE *file, int address) {
+	const Label *label = labelFor(profiler, address);
+	
+	if(label != NULL && label->address == address) {
+		fputs(label->name, file);
+	} else {
+		fprintf(file, "$%04X", address);
+	}
+}
+
+void writeFoldedStacks(Profiler *profiler, FILE *file) {
+	int i, j;
+	
+	for(i = 0; i < profiler->stackCapacity; i++) {
+		Stack *stack = &profiler->stacks[i];
+		if(stack->count == 0) {
+			continue;
+		}
+		for(j = 0; j < stack->depth; j++) {
+			if(j > 0) {
+				putc(';', file);
+			}
+			writeFrame(profiler, file, stack->frames[j]);
+		}
+		fprintf(file, " %li\n", stack->count);
+	}
+}
+
+long profilerSamples(Profiler *profiler) {
+	return profiler->samples;
+}
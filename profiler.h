@@ -0,0 +1,43 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdio.h>
+#include "cpu.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Statistical guest profiler: every interval cycles the run stops at the next instruction boundary and the
+// profiler takes pc and the JSR call stack, rebuilt from the return addresses on the guest stack page (a pair
+// of bytes counts as one when the three bytes before the address it points past are a JSR). Nothing runs
+// between samples, so the cost is one sample per interval however long the run is.
+// Output is folded stacks (caller;callee;... count per line) for flamegraph.pl and compatible viewers, with
+// frames named from an assembler label map (nearest label at or below the address) or as $hex without one.
+// Stacks are heuristic: data pushed on the stack that happens to look like a return address adds a frame.
+
+typedef struct Profiler Profiler;
+
+// NULL if it can't allocate or interval is not positive
+Profiler *createProfiler(long interval);
+void freeProfiler(Profiler *profiler);
+
+// Label map lines are "al 004000 .name" (VICE, ld65 -Ln), "name = $4000" or "4000 name";
+// anything else is skipped. Returns the number of labels loaded, -1 if it can't allocate.
+int loadProfilerLabels(Profiler *profiler, FILE *file);
+
+// the first sample is taken interval cycles after cycles
+void startProfiler(Profiler *profiler, long long cycles);
+// cycle count the run has to stop at (or after) for the next sample
+long long nextProfilerSample(Profiler *profiler);
+// records a sample weighted by the intervals that passed since the last one (idle loops skip many at once)
+void sampleProfiler(Profiler *profiler, CPU *cpu);
+
+void writeFoldedStacks(Profiler *profiler, FILE *file);
+long profilerSamples(Profiler *profiler);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
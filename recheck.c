@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include <string.h>
+#include "cpu.h"
+#include "recompiled.h"
+
+// Regression check of the recompiler against the interpreter: make recheck recompiles test.bin (loaded at $4000, as
+// test.c runs it) to recheck_image.c and builds this with it. Every budget runs the image once with step() and once
+// with runRecompiled, stopping inside and between blocks, and both runs have to end with the same registers, cycles,
+// page crossings and memory (and built with CYCLE_EXACT=1, the same bus accesses in the same order).
+
+#define RECHECK_ORIGIN 0x4000
+
+extern const RecompiledImage recheckImage;
+
+static const long long budgets[] = { 1, 7, 100, 1000, 12345, 100000, 1000000 };
+
+#ifdef CYCLE_EXACT
+static unsigned long busHash;
+
+// FNV-1a over every bus cycle
+static void hashBus(CPU *cpu, int address, unsigned char value, int type) {
+	busHash = (busHash ^ (unsigned long)((address << 0x9) | (value << 0x1) | type)) * 1099511628211UL;
+}
+#endif
+
+static void load(CPU *cpu, const char *image, int length) {
+	initializeCPU(cpu);
+	cpu->jamOnUnknownOpcode = 1;
+	writeMemory(cpu, (char *)image, RECHECK_ORIGIN, length);
+	cpu->pc = RECHECK_ORIGIN;
+#ifdef CYCLE_EXACT
+	cpu->busCallback = hashBus;
+	busHash = 14695981039346656037UL;
+#endif
+}
+
+static int sameState(CPU *first, CPU *second) {
+	return first->cycles == second->cycles && first->pc == second->pc && first->sp == second->sp && first->a == second->a &&
+		first->x == second->x && first->y == second->y && first->ps == second->ps && first->pageCrossings == second->pageCrossings &&
+		first->jammed == second->jammed && memcmp(first->ram, second->ram, MEMORY_SIZE) == 0;
+}
+
+int main(int argc, char *argv[]) {
+	const char *image_name = (argc > 1 ? argv[1] : "test.bin");
+	static char image[MEMORY_SIZE];
+	int differences = 0;
+	int i;
+
+	FILE *file = fopen(image_name, "rb");
+	if(file == NULL) {
+		printf("Can't open %s.\n", image_name);
+		return 1;
+	}
+	int length = fread(image, 1, MEMORY_SIZE - RECHECK_ORIGIN, file);
+	fclose(file);
+
+	for(i = 0; i < (int)(sizeof(budgets) / sizeof(budgets[0])); i++) {
+		CPU stepped, recompiled;
+		unsigned long stepped_bus = 0, recompiled_bus = 0;
+
+		load(&stepped, image, length);
+		while(stepped.cycles < budgets[i] && !stepped.jammed) {
+			step(&stepped);
+		}
+#ifdef CYCLE_EXACT
+		stepped_bus = busHash;
+#endif
+
+		load(&recompiled, image, length);
+		RecompiledState *state = attachRecompiled(&recompiled, &recheckImage);
+		if(state == NULL) {
+			printf("Can't attach the recompiled image.\n");
+			return 1;
+		}
+		runRecompiled(state, budgets[i]);
+		detachRecompiled(state);
+#ifdef CYCLE_EXACT
+		recompiled_bus = busHash;
+#endif
+
+		if(!sameState(&stepped, &recompiled) || stepped_bus != recompiled_bus) {
+			printf("%lld cycles: step() ends at pc %x after %lld cycles, runRecompiled at pc %x after %lld cycles%s\n", budgets[i],
+				stepped.pc, stepped.cycles, recompiled.pc, recompiled.cycles, (stepped_bus != recompiled_bus ? ", bus accesses differ" : ""));
+			differences++;
+		}
+		freeCPU(&stepped);
+		freeCPU(&recompiled);
+	}
+
+	printf("RECHECK: %i budgets, %i differences\n", (int)(sizeof(budgets) / sizeof(budgets[0])), differences);
+	return differences == 0 ? 0 : 1;
+}
@@ -0,0 +1,286 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cpu.h"
+#include "flow.h"
+
+// Recompiles a guest image ahead of time to C: ./6502_recompile [-c] [-u] image name [load address [entry ...]]
+// -c recompiles for the 65C02, -u with the undocumented NMOS opcodes. The image is loaded at the load address
+// ($4000 by default, like test.c), which is also the entry point unless others are given; addresses are hex.
+// The C goes to stdout and defines the RecompiledImage name (see recompiled.h); build it with the emulator's
+// sources, it includes core.h.
+//
+// Control flow comes from flow.h, one C function per routine with a label per block. Every instruction is the
+// same shape statement step() runs for its opcode (core.h), so flags, cycles and bus accesses can't drift from
+// the interpreter; only the opcode fetch and the dispatch go. Operands are still read from guest memory.
+// Branches and jumps inside a routine are gotos; anything leaving it (JSR, RTS, jumps into other routines)
+// returns to the dispatch function, which calls the routine holding the block at the new pc.
+// A block runs only if the cycles before its last instruction, counted with every penalty, stay below the end
+// of the run, so runs stop on the same instruction as the interpreter. Pages that the image's own instructions
+// write are not recompiled at all, and blocks check before they start, and after every store through a pointer,
+// that none of their pages were written since.
+
+#define RECOMPILE_DEFAULT_ORIGIN 0x4000
+#define RECOMPILE_MAX_ENTRIES 64
+#define RECOMPILE_MAX_PENALTY 2 // cycles an instruction can take over its base: a taken branch to another page
+
+static const char *shapes[256]; // shape statement of every opcode the variant runs, from its opcode tables
+
+static void setShape(int opcode, const char *shape) {
+	if(shapes[opcode] == NULL) {
+		shapes[opcode] = shape; // the first table that has it wins, like the step functions' switches
+	}
+}
+
+static void fillShapes(int variant, int undocumented) {
+#define READ(opcode, operation, mode, cycles) setShape(opcode, "READ_INSTRUCTION(" #operation ", " #mode ", " #cycles ")");
+#define WRITE(opcode, operation, mode, cycles) setShape(opcode, "WRITE_INSTRUCTION(" #operation ", " #mode ", " #cycles ")");
+#define MODIFY(opcode, operation, mode, cycles) setShape(opcode, "MODIFY_INSTRUCTION(" #operation ", " #mode ", " #cycles ")");
+#define MODIFY_PAGED(opcode, operation, mode, cycles) setShape(opcode, "MODIFY_PAGED_INSTRUCTION(" #operation ", " #mode ", " #cycles ")");
+#define MODIFY_ACCUMULATOR(opcode, operation, cycles) setShape(opcode, "MODIFY_ACCUMULATOR_INSTRUCTION(" #operation ", " #cycles ")");
+#define IMPLIED(opcode, operation, cycles) setShape(opcode, "IMPLIED_INSTRUCTION(" #operation ", " #cycles ")");
+#define BRANCH(opcode, condition) setShape(opcode, "BRANCH_INSTRUCTION(" #condition ")");
+#define CONTROL(opcode, operation, cycles) setShape(opcode, "CONTROL_INSTRUCTION(" #operation ", " #cycles ")");
+#include "opcodes.h"
+	if(variant == CPU_65C02) {
+#include "opcodes_65c02.h"
+	} else {
+#include "opcodes_nmos.h"
+		if(undocumented) {
+#include "opcodes_undocumented.h"
+		}
+	}
+}
+
+// pages 0 and 1 ignore hooks, so writes to them can't be watched; pages the image writes itself change anyway
+static int isRecompiledPage(const FlowGraph *graph, int page) {
+	return page >= 2 && !(graph->pages[page] & FLOW_PAGE_WRITTEN);
+}
+
+static int isRecompiled(const FlowGraph *graph, const FlowBlock *block) {
+	int last_byte = (block->end - 1) & 0xFFFF;
+	return block->routine >= 0 && isRecompiledPage(graph, block->start >> 0x8) && isRecompiledPage(graph, last_byte >> 0x8) &&
+		(block->start >> 0x8) <= (last_byte >> 0x8); // not wrapping past $FFFF
+}
+
+// the block at address, if it is recompiled into routine; NULL means leaving the routine
+static const FlowBlock *blockInRoutine(const FlowGraph *graph, int address, int routine) {
+	const FlowBlock *block = flowBlockAt(graph, address);
+	return block != NULL && block->routine == routine && isRecompiled(graph, block) ? block : NULL;
+}
+
+static void printWrittenCheck(const FlowBlock *block) {
+	int first_page = block->start >> 0x8;
+	int last_page = ((block->end - 1) & 0xFFFF) >> 0x8;
+
+	printf("state->written[0x%02X]", first_page);
+	if(last_page != first_page) {
+		printf(" || state->written[0x%02X]", last_page);
+	}
+}
+
+static void printExit(const FlowGraph *graph, int address, int routine) {
+	if(blockInRoutine(graph, address, routine) != NULL) {
+		printf("goto block%04X;", address);
+	} else {
+		printf("return 1;");
+	}
+}
+
+static void printBlock(const FlowGraph *graph, const FlowBlock *block) {
+	int worst_cycles = 0;
+	int address = block->start;
+	int i;
+
+	for(i = 0; i < block->instructionCount - 1; i++) {
+		const FlowInstruction *instruction = flowInstructionAt(graph, address);
+		worst_cycles += instruction->cycles + RECOMPILE_MAX_PENALTY;
+		address = (address + instruction->length) & 0xFFFF;
+	}
+
+	printf("block%04X: // %i instructions, %i cycles\n", block->start, block->instructionCount, block->cycles);
+	printf("\tif(cpu->cycles + %i >= end_cycles || ", worst_cycles);
+	printWrittenCheck(block);
+	printf(") return ran;\n");
+	printf("\tran = 1;\n");
+
+	address = block->start;
+	for(i = 0; i < block->instructionCount; i++) {
+		const FlowInstruction *instruction = flowInstructionAt(graph, address);
+		printf("\tOPCODE_FETCH(0x%04X) cpu->pc = 0x%04X; %s\n", address, (address + 1) & 0xFFFF, shapes[instruction->opcode]);
+		if((instruction->access & FLOW_ACCESS_WRITE) && (instruction->mode == FLOW_MODE_IndexedIndirect ||
+			instruction->mode == FLOW_MODE_IndirectIndexed || instruction->mode == FLOW_MODE_ZeroPageIndirect)) {
+			printf("\tif(");
+			printWrittenCheck(block); // the store may have hit this very block
+			printf(") return 1;\n");
+		}
+		address = (address + instruction->length) & 0xFFFF;
+	}
+
+	// pc is already where control goes next
+	const FlowInstruction *last = flowInstructionAt(graph, block->last);
+	printf("\t");
+	switch(last->kind) {
+		case FLOW_BRANCH:
+			printf("if(cpu->pc == 0x%04X) ", last->target);
+			printExit(graph, last->target, block->routine);
+			printf("\n\t"); // the fall through on its own line, not under the if
+			printExit(graph, block->end, block->routine);
+			break;
+		case FLOW_JUMP:
+			printExit(graph, last->target, block->routine);
+			break;
+		case FLOW_STEP:
+			printExit(graph, block->end, block->routine);
+			break;
+		default: // JSR, RTS, RTI, BRK, JMP indirect
+			printf("return 1;");
+			break;
+	}
+	printf("\n");
+}
+
+static void printRoutine(const FlowGraph *graph, int routine) {
+	int i;
+
+	printf("\n// routine $%04X\n", graph->routines[routine]);
+	printf("static int routine%04X(CPU *cpu, RecompiledState *state, long long end_cycles) {\n", graph->routines[routine]);
+	printf("\tint ran = 0;\n\n");
+	printf("\tswitch(cpu->pc) {\n");
+	for(i = 0; i < graph->blockCount; i++) {
+		if(graph->blocks[i].routine == routine && isRecompiled(graph, &graph->blocks[i])) {
+			printf("\t\tcase 0x%04X: goto block%04X;\n", graph->blocks[i].start, graph->blocks[i].start);
+		}
+	}
+	printf("\t\tdefault: return 0;\n");
+	printf("\t}\n\n");
+	for(i = 0; i < graph->blockCount; i++) {
+		if(graph->blocks[i].routine == routine && isRecompiled(graph, &graph->blocks[i])) {
+			printBlock(graph, &graph->blocks[i]);
+		}
+	}
+	printf("}\n");
+}
+
+static int hasRecompiledBlocks(const FlowGraph *graph, int routine) {
+	int i;
+
+	for(i = 0; i < graph->blockCount; i++) {
+		if(graph->blocks[i].routine == routine && isRecompiled(graph, &graph->blocks[i])) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void printImage(const FlowGraph *graph, const char *image, const char *name, int variant, int undocumented) {
+	int recompiled_blocks = 0;
+	int routine, i;
+
+	for(i = 0; i < graph->blockCount; i++) {
+		recompiled_blocks += isRecompiled(graph, &graph->blocks[i]);
+	}
+	printf("// %s recompiled by 6502_recompile: %i of %i blocks in %i routines (see recompiled.h)\n", image, recompiled_blocks,
+		graph->blockCount, graph->routineCount);
+	printf("#include \"core.h\"\n");
+	printf("#include \"recompiled.h\"\n\n");
+	printf("#if defined(CYCLE_EXACT) || defined(HEATMAP) || defined(COVERAGE)\n");
+	printf("#define OPCODE_FETCH(address) cpu->pc = (address); coverInstruction(cpu); fetchByte(cpu); // the bus, heatmap and coverage still see it\n");
+	printf("#else\n");
+	printf("#define OPCODE_FETCH(address)\n");
+	printf("#endif\n");
+
+	for(routine = 0; routine < graph->routineCount; routine++) {
+		if(hasRecompiledBlocks(graph, routine)) {
+			printRoutine(graph, routine);
+		}
+	}
+
+	printf("\nstatic int run(CPU *cpu, RecompiledState *state, long long end_cycles) {\n");
+	printf("\tswitch(cpu->pc) {\n");
+	for(routine = 0; routine < graph->routineCount; routine++) {
+		for(i = 0; i < graph->blockCount; i++) {
+			if(graph->blocks[i].routine == routine && isRecompiled(graph, &graph->blocks[i])) {
+				printf("\t\tcase 0x%04X:\n", graph->blocks[i].start);
+			}
+		}
+		if(hasRecompiledBlocks(graph, routine)) {
+			printf("\t\t\treturn routine%04X(cpu, state, end_cycles);\n", graph->routines[routine]);
+		}
+	}
+	printf("\t}\n");
+	printf("\treturn 0;\n");
+	printf("}\n\n");
+
+	printf("static const unsigned char pages[MEMORY_PAGES] = {");
+	for(i = 0; i < MEMORY_PAGES; i++) {
+		if((graph->pages[i] & FLOW_PAGE_CODE) && isRecompiledPage(graph, i)) {
+			printf(" [0x%02X] = 1,", i);
+		}
+	}
+	printf(" };\n\n");
+	printf("const RecompiledImage %s = { %s, %i, run, pages };\n", name, variant == CPU_65C02 ? "CPU_65C02" : "CPU_NMOS", undocumented);
+}
+
+int main(int argc, char *argv[]) {
+	int entries[RECOMPILE_MAX_ENTRIES];
+	int entry_count = 0;
+	int origin = RECOMPILE_DEFAULT_ORIGIN;
+	int variant = CPU_NMOS;
+	int undocumented = 0;
+	int argument = 1;
+
+	for(; argument < argc && argv[argument][0] == '-'; argument++) {
+		if(strcmp(argv[argument], "-c") == 0) {
+			variant = CPU_65C02;
+		} else if(strcmp(argv[argument], "-u") == 0) {
+			undocumented = 1;
+		} else {
+			break;
+		}
+	}
+	if(argc - argument < 2 || argc - argument - 3 > RECOMPILE_MAX_ENTRIES || (argv[argument][0] == '-')) {
+		fprintf(stderr, "Usage: %s [-c] [-u] image name [load address [entry ...]]\n", argv[0]);
+		return -1;
+	}
+	const char *image_name = argv[argument];
+	const char *name = argv[argument + 1];
+	if(argc - argument > 2) {
+		origin = strtol(argv[argument + 2], NULL, 16) & 0xFFFF;
+	}
+	for(argument += 3; argument < argc; argument++) {
+		entries[entry_count++] = strtol(argv[argument], NULL, 16) & 0xFFFF;
+	}
+	if(entry_count == 0) {
+		entries[entry_count++] = origin;
+	}
+
+	FILE *file = fopen(image_name, "rb");
+	if(file == NULL) {
+		fprintf(stderr, "Can't open %s.\n", image_name);
+		return -1;
+	}
+	char *image = malloc(MEMORY_SIZE);
+	int length = fread(image, 1, MEMORY_SIZE - origin, file);
+	fclose(file);
+
+	CPU cpu;
+	initializeCPU(&cpu);
+	cpu.variant = variant;
+	cpu.undocumentedOpcodes = undocumented;
+	writeMemory(&cpu, image, origin, length);
+	free(image);
+
+	FlowGraph *graph = analyzeFlow(&cpu, entries, entry_count);
+	if(graph == NULL) {
+		fprintf(stderr, "Out of memory.\n");
+		freeCPU(&cpu);
+		return -1;
+	}
+	fillShapes(variant, undocumented);
+	printImage(graph, image_name, name, variant, undocumented);
+
+	freeFlowGraph(graph);
+	freeCPU(&cpu);
+	return 0;
+}
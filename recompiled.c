@@ -0,0 +1,62 @@
+#include "recompiled.h"
+
+// write hook of the pages holding recompiled code
+static void writeRecompiledPage(CPU *cpu, int address, unsigned char value, void *context) {
+	RecompiledState *state = context;
+	*memoryByte(cpu, address) = value;
+	state->written[address >> 0x8] = 1;
+}
+
+RecompiledState *attachRecompiled(CPU *cpu, const RecompiledImage *image) {
+	RecompiledState *state;
+	int page;
+	
+	if(cpu->variant != image->variant || (image->undocumentedOpcodes && !cpu->undocumentedOpcodes)) {
+		return NULL;
+	}
+	if((state = calloc(1, sizeof(RecompiledState))) == NULL) {
+		return NULL;
+	}
+	state->image = image;
+	state->cpu = cpu;
+	state->hook.write = writeRecompiledPage;
+	state->hook.context = state;
+	
+	for(page = 0; page < MEMORY_PAGES; page++) {
+		if(!image->pages[page]) {
+			continue;
+		}
+		if(page < 2 || cpu->hooks[page] != NULL) { // pages 0 and 1 ignore hooks
+			state->written[page] = 1;
+		} else {
+			cpu->hooks[page] = &state->hook;
+		}
+	}
+	return state;
+}
+
+void detachRecompiled(RecompiledState *state) {
+	int page;
+	
+	if(state == NULL) {
+		return;
+	}
+	for(page = 0; page < MEMORY_PAGES; page++) {
+		if(state->cpu->hooks[page] == &state->hook) {
+			state->cpu->hooks[page] = NULL;
+		}
+	}
+	free(state);
+}
+
+long long runRecompiled(RecompiledState *state, long long end_cycles) {
+	CPU *cpu = state->cpu;
+	long long start_cycles = cpu->cycles;
+	
+	while(cpu->cycles < end_cycles && !cpu->jammed) {
+		if(!state->image->run(cpu, state, end_cycles)) {
+			step(cpu); // nothing recompiled here, or the next block could run past end_cycles
+		}
+	}
+	return cpu->cycles - start_cycles;
+}
@@ -0,0 +1,47 @@
+#ifndef RECOMPILED_H
+#define RECOMPILED_H
+
+#include "cpu.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Runs a guest image recompiled ahead of time to C by 6502_recompile (see recompile.c): compile the generated file
+// with the emulator's sources, attach the RecompiledImage it defines to a CPU loaded with the same image, and
+// runRecompiled instead of stepping. Recompiled blocks run the same statements as step() (flags, cycles, and with
+// CYCLE_EXACT every bus access), without fetching or dispatching opcodes; anything else runs in the interpreter:
+// code the recompiler didn't find (JMP indirect targets, code copied to RAM), code on pages the image writes, and
+// from the first guest write on, every page holding recompiled code that got written (a write hook on those pages
+// watches them). Host changes to recompiled code (writeMemory) are not seen, reattach after making them.
+
+typedef struct RecompiledState RecompiledState;
+
+typedef struct {
+	int variant; // CPU_NMOS or CPU_65C02, the instruction set it was recompiled for
+	int undocumentedOpcodes;
+	// runs recompiled code from cpu->pc as long as every block fits before end_cycles; 0 if there is none to run there
+	int (*run)(CPU *cpu, RecompiledState *state, long long end_cycles);
+	const unsigned char *pages; // MEMORY_PAGES entries, non zero for pages holding recompiled code
+} RecompiledImage;
+
+struct RecompiledState {
+	const RecompiledImage *image;
+	CPU *cpu;
+	unsigned char written[MEMORY_PAGES]; // recompiled code pages the interpreter runs from now on
+	MemoryHook hook;
+};
+
+// NULL if cpu runs another instruction set than image or it can't allocate. Pages that already have hooks
+// (devices, bank registers) are left to the interpreter.
+RecompiledState *attachRecompiled(CPU *cpu, const RecompiledImage *image);
+void detachRecompiled(RecompiledState *state);
+
+// runs whole instructions until at least end_cycles or the CPU jams, like stepping does; returns the cycles run
+long long runRecompiled(RecompiledState *state, long long end_cycles);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,281 @@
+#include <string.h>
+#include "replay.h"
+
+#define REPLAY_MAGIC "6502RPL1"
+
+#define REPLAY_READ 1 // address (2 bytes), value
+#define REPLAY_WRITE 2 // address (2 bytes), length (LEB128), bytes
+#define REPLAY_REGISTERS 3 // pc (2 bytes), a, x, y, sp, ps, new cycles (LEB128, absolute)
+
+typedef struct {
+	int type; // 0 at the end of the log
+	long long cycles; // when it happened
+	long long newCycles; // REPLAY_REGISTERS
+	int address;
+	unsigned char value;
+	int length;
+	unsigned char *data; // MEMORY_SIZE bytes
+} ReplayRecord;
+
+struct ReplayLog {
+	CPU *cpu;
+	FILE *file;
+	int mode;
+	long long lastCycles;
+	int diverged;
+	ReplayRecord next; // replaying: the record the run gets to next
+	MemoryHook *devices[MEMORY_PAGES]; // hooks the log stands in front of, NULL for pages it leaves alone
+	MemoryHook hooks[MEMORY_PAGES];
+};
+
+static void writeNumber(FILE *file, unsigned long long value) {
+	while(value >= 0x80) {
+		putc((value & 0x7F) | 0x80, file);
+		value >>= 0x7;
+	}
+	putc(value, file);
+}
+
+static long long readNumber(FILE *file) {
+	unsigned long long value = 0;
+	int shift = 0;
+	int byte;
+	
+	do {
+		byte = getc(file);
+		if(byte == EOF) {
+			return -1;
+		}
+		value |= (unsigned long long)(byte & 0x7F) << shift;
+		shift += 7;
+	} while(byte & 0x80);
+	
+	return value;
+}
+
+static void writeRecordHeader(ReplayLog *log, int type, long long cycles, int address) {
+	putc(type, log->file);
+	writeNumber(log->file, cycles - log->lastCycles);
+	putc(address & 0xFF, log->file);
+	putc((address >> 0x8) & 0xFF, log->file);
+	log->lastCycles = cycles;
+}
+
+static void readNextRecord(ReplayLog *log) {
+	ReplayRecord *record = &log->next;
+	int type = getc(log->file);
+	long long delta = (type == EOF ? -1 : readNumber(log->file));
+	int low_byte = getc(log->file);
+	int high_byte = getc(log->file);
+	
+	record->type = 0;
+	if(delta < 0 || high_byte == EOF) {
+		return;
+	}
+	record->cycles = log->lastCycles + delta;
+	record->address = low_byte | (high_byte << 0x8);
+	log->lastCycles = record->cycles;
+	
+	if(type == REPLAY_READ) {
+		record->value = getc(log->file);
+	} else if(type == REPLAY_WRITE) {
+		record->length = readNumber(log->file);
+		if(record->length < 0 || record->length > MEMORY_SIZE || fread(record->data, 1, record->length, log->file) != (size_t)record->length) {
+			return;
+		}
+	} else if(type == REPLAY_REGISTERS) {
+		if(fread(record->data, 1, 5, log->file) != 5) {
+			return;
+		}
+		record->newCycles = readNumber(log->file);
+		log->lastCycles = record->newCycles;
+	} else {
+		return;
+	}
+	record->type = type;
+}
+
+static unsigned char readDevice(CPU *cpu, int address, void *context) {
+	ReplayLog *log = context;
+	MemoryHook *device = log->devices[address >> 0x8];
+	unsigned char value;
+	
+	if(log->mode == REPLAY_RECORD) {
+		value = device->read(cpu, address, device->context);
+		writeRecordHeader(log, REPLAY_READ, cpu->cycles, address);
+		putc(value, log->file);
+		return value;
+	}
+	
+	if(log->next.type == REPLAY_READ && log->next.cycles == cpu->cycles && log->next.address == address) {
+		value = log->next.value;
+		readNextRecord(log);
+		return value;
+	}
+	log->diverged = 1; // keep going with the real device
+	return device->read(cpu, address, device->context);
+}
+
+static void writeDevice(CPU *cpu, int address, unsigned char value, void *context) {
+	ReplayLog *log = context;
+	MemoryHook *device = log->devices[address >> 0x8];
+	
+	if(device->write != NULL) {
+		device->write(cpu, address, value, device->context);
+	} else {
+		*memoryByte(cpu, address) = value;
+	}
+}
+
+static void writeSnapshot(ReplayLog *log) {
+	CPU *cpu = log->cpu;
+	int page;
+	
+	fwrite(REPLAY_MAGIC, 1, 8, log->file);
+	putc(cpu->pc & 0xFF, log->file);
+	putc((cpu->pc >> 0x8) & 0xFF, log->file);
+	putc(cpu->a, log->file);
+	putc(cpu->x, log->file);
+	putc(cpu->y, log->file);
+	putc(cpu->sp, log->file);
+	putc(cpu->ps, log->file);
+	writeNumber(log->file, cpu->cycles);
+	for(page = 0; page < MEMORY_PAGES; page++) {
+		fwrite(cpu->memory[page], 1, PAGE_SIZE, log->file);
+	}
+}
+
+static int readSnapshot(ReplayLog *log) {
+	CPU *cpu = log->cpu;
+	unsigned char header[15];
+	int page;
+	
+	if(fread(header, 1, 15, log->file) != 15 || memcmp(header, REPLAY_MAGIC, 8) != 0) {
+		return -1;
+	}
+	cpu->pc = header[8] | (header[9] << 0x8);
+	cpu->a = header[10];
+	cpu->x = header[11];
+	cpu->y = header[12];
+	cpu->sp = header[13];
+	cpu->ps = header[14];
+	cpu->cycles = readNumber(log->file);
+	for(page = 0; page < MEMORY_PAGES; page++) {
+		if(fread(cpu->memory[page], 1, PAGE_SIZE, log->file) != PAGE_SIZE) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+ReplayLog *openReplayLog(CPU *cpu, FILE *file, int mode) {
+	ReplayLog *log = calloc(1, sizeof(ReplayLog));
+	int page;
+	
+	if(log == NULL) {
+		return NULL;
+	}
+	log->cpu = cpu;
+	log->file = file;
+	log->mode = mode;
+	
+	if(mode == REPLAY_RECORD) {
+		writeSnapshot(log);
+	} else {
+		log->next.data = malloc(MEMORY_SIZE);
+		if(log->next.data == NULL || readSnapshot(log) < 0) {
+			free(log->next.data);
+			free(log);
+			return NULL;
+		}
+	}
+	log->lastCycles = cpu->cycles;
+	if(mode == REPLAY_PLAY) {
+		readNextRecord(log);
+	}
+	
+	for(page = 0; page < MEMORY_PAGES; page++) {
+		MemoryHook *device = cpu->hooks[page];
+		if(device != NULL && device->read != NULL) {
+			log->devices[page] = device;
+			log->hooks[page].read = readDevice;
+			log->hooks[page].write = writeDevice;
+			log->hooks[page].context = log;
+			cpu->hooks[page] = &log->hooks[page];
+		}
+	}
+	
+	return log;
+}
+
+void closeReplayLog(ReplayLog *log) {
+	int page;
+	
+	if(log == NULL) {
+		return;
+	}
+	for(page = 0; page < MEMORY_PAGES; page++) {
+		if(log->devices[page] != NULL && log->cpu->hooks[page] == &log->hooks[page]) {
+			log->cpu->hooks[page] = log->devices[page];
+		}
+	}
+	fflush(log->file);
+	free(log->next.data);
+	free(log);
+}
+
+void recordHostWrite(ReplayLog *log, int start, const unsigned char *buffer, int length) {
+	writeRecordHeader(log, REPLAY_WRITE, log->cpu->cycles, start);
+	writeNumber(log->file, length);
+	fwrite(buffer, 1, length, log->file);
+}
+
+void recordHostRegisters(ReplayLog *log, long long previous_cycles) {
+	CPU *cpu = log->cpu;
+	
+	writeRecordHeader(log, REPLAY_REGISTERS, previous_cycles, cpu->pc);
+	putc(cpu->a, log->file);
+	putc(cpu->x, log->file);
+	putc(cpu->y, log->file);
+	putc(cpu->sp, log->file);
+	putc(cpu->ps, log->file);
+	writeNumber(log->file, cpu->cycles);
+	log->lastCycles = cpu->cycles;
+}
+
+long long nextReplayStop(ReplayLog *log) {
+	ReplayRecord *record = &log->next;
+	
+	while(record->type == REPLAY_READ && record->cycles < log->cpu->cycles) { // the run went past it without making the read
+		log->diverged = 1;
+		readNextRecord(log);
+	}
+	if(record->type == REPLAY_READ) {
+		return record->cycles + 1; // a read happens before the end of its instruction
+	}
+	return (record->type != 0 ? record->cycles : -1);
+}
+
+void applyReplayedHostInput(ReplayLog *log) {
+	CPU *cpu = log->cpu;
+	ReplayRecord *record = &log->next;
+	
+	while((record->type == REPLAY_WRITE || record->type == REPLAY_REGISTERS) && record->cycles <= cpu->cycles) {
+		if(record->type == REPLAY_WRITE) {
+			writeMemory(cpu, (char *)record->data, record->address, record->length);
+		} else {
+			cpu->pc = record->address;
+			cpu->a = record->data[0];
+			cpu->x = record->data[1];
+			cpu->y = record->data[2];
+			cpu->sp = record->data[3];
+			cpu->ps = record->data[4];
+			cpu->cycles = record->newCycles;
+		}
+		readNextRecord(log);
+	}
+}
+
+int replayDiverged(ReplayLog *log) {
+	return log->diverged;
+}
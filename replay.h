@@ -0,0 +1,49 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdio.h>
+#include "cpu.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Deterministic record/replay. Recording writes a snapshot (registers and the 64 KiB address space) and then
+// everything that reaches the CPU from outside, tagged with cpu->cycles: the values read hooks return (device
+// registers) and the host's writes to memory and registers. Replaying loads the snapshot and hands the logged
+// values back instead of asking the devices, so the run repeats bit for bit.
+// Only the read hooks attached when the log is opened are logged; write hooks keep running during replay
+// (bank switching has to happen again), so attach the same devices before replaying.
+// Host changes are applied when the replaying run gets to their cycle count and goes on, so the ones logged after
+// the recording's last instruction (by the host between its last emulatorRun and stopping) only apply if the
+// replay runs past that cycle count; a replay stopping right at it ends without them.
+//
+// Format, streamed as it goes: "6502RPL1", the snapshot, then records of a type byte, the cycles since the
+// previous record (LEB128) and the payload. Reads, the bulk of a log, take 4 or 5 bytes.
+
+#define REPLAY_RECORD 0
+#define REPLAY_PLAY 1
+
+typedef struct ReplayLog ReplayLog;
+
+// NULL if it can't allocate or (when replaying) file is not a log
+ReplayLog *openReplayLog(CPU *cpu, FILE *file, int mode);
+void closeReplayLog(ReplayLog *log); // puts the device hooks back, the file stays open
+
+// recording: the host changed memory or registers between instructions
+// (recordHostRegisters after the change, with cpu->cycles from before it, since the host may set cycles too)
+void recordHostWrite(ReplayLog *log, int start, const unsigned char *buffer, int length);
+void recordHostRegisters(ReplayLog *log, long long previous_cycles);
+
+// replaying: where the run has to stop next (-1 at the end of the log), and applying the host changes due now.
+// A host change is due at its own cycle count, a logged read stops the run after the instruction making it,
+// so a run never passes a host change that comes after the read in the log.
+long long nextReplayStop(ReplayLog *log);
+void applyReplayedHostInput(ReplayLog *log);
+int replayDiverged(ReplayLog *log); // non zero once the run asked for something the log doesn't have
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
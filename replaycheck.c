@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <string.h>
+#include "cpu.h"
+#include "emulator.h"
+
+// Record/replay round trip: a guest reads a device returning random values while the host writes memory and sets
+// registers between runs; replaying the log, in runs of other lengths and with the device returning something
+// else, has to end with the same memory, registers and cycles, and without diverging from the log.
+
+#define CHECK_ORIGIN 0x0400
+#define DEVICE_PAGE 0xD0
+
+// stores and sums device reads: LDA $D000 / STA $3000,Y / ADC $D001 / STA $10 / INY / BNE, INC $11, JMP
+static const unsigned char program[] = {
+	0xA0, 0x00,       // LDY #0
+	0xAD, 0x00, 0xD0, // LDA $D000
+	0x99, 0x00, 0x30, // STA $3000,Y
+	0x6D, 0x01, 0xD0, // ADC $D001
+	0x85, 0x10,       // STA $10
+	0xC8,             // INY
+	0xD0, 0xF2,       // BNE -14
+	0xE6, 0x11,       // INC $11
+	0x4C, 0x00, 0x04, // JMP $0400
+};
+
+static const long long recordLengths[] = { 10, 1000, 333, 5000, 7, 20000, 64, 12345 };
+static const long long replayLengths[] = { 1, 4000, 17, 50000, 2, 999 };
+
+static int replays = 0;
+static int differences = 0;
+
+static unsigned char readRandom(CPU *cpu, int address, void *context) {
+	unsigned int *seed = context;
+	*seed = *seed * 1103515245u + 12345u;
+	return *seed >> 16;
+}
+
+static Emulator *createWithDevice(MemoryHook *device) {
+	Emulator *emulator = emulatorCreate();
+	if(emulator != NULL) {
+		emulatorGetCPU(emulator)->hooks[DEVICE_PAGE] = device;
+	}
+	return emulator;
+}
+
+// between runs: data the guest doesn't write, the sum it keeps at $10 and the registers (cycles stay)
+static void changeFromHost(Emulator *emulator, int run) {
+	unsigned char data[16];
+	EmulatorRegisters registers;
+	int i;
+
+	for(i = 0; i < (int)sizeof(data); i++) {
+		data[i] = run * 16 + i;
+	}
+	emulatorWriteMemory(emulator, data, 0x3100 + run * 16, sizeof(data));
+	emulatorWriteMemory(emulator, data, 0x10, 1);
+	emulatorGetRegisters(emulator, &registers);
+	registers.a ^= 0x5A;
+	registers.x = run;
+	registers.ps ^= 0x01;
+	emulatorSetRegisters(emulator, &registers);
+}
+
+static int sameState(Emulator *first, Emulator *second) {
+	static unsigned char first_memory[MEMORY_SIZE], second_memory[MEMORY_SIZE];
+	EmulatorRegisters first_registers, second_registers;
+
+	emulatorGetRegisters(first, &first_registers);
+	emulatorGetRegisters(second, &second_registers);
+	emulatorReadMemory(first, first_memory, 0, MEMORY_SIZE);
+	emulatorReadMemory(second, second_memory, 0, MEMORY_SIZE);
+	return first_registers.pc == second_registers.pc && first_registers.sp == second_registers.sp && first_registers.a == second_registers.a &&
+		first_registers.x == second_registers.x && first_registers.y == second_registers.y && first_registers.ps == second_registers.ps &&
+		first_registers.cycles == second_registers.cycles && memcmp(first_memory, second_memory, MEMORY_SIZE) == 0;
+}
+
+// replays file up to end_cycles in runs of lengths (all of it in one run for a single length of 0)
+static void checkReplay(const char *name, FILE *file, Emulator *recorded, long long end_cycles, const long long *lengths, int length_count) {
+	unsigned int seed = 99; // not the recording's: a read the log doesn't cover comes out different
+	MemoryHook device = { readRandom, NULL, &seed };
+	EmulatorRegisters registers, recorded_registers;
+	int run = 0;
+
+	Emulator *emulator = createWithDevice(&device);
+	rewind(file);
+	if(emulator == NULL || emulatorReplay(emulator, file) < 0) {
+		printf("%s: can't replay the log\n", name);
+		differences++;
+		emulatorDestroy(emulator);
+		return;
+	}
+	emulatorGetRegisters(emulator, &registers);
+	while(registers.cycles < end_cycles) {
+		long long cycles = (lengths[run % length_count] > 0 ? lengths[run % length_count] : end_cycles);
+		emulatorRun(emulator, (cycles < end_cycles - registers.cycles ? cycles : end_cycles - registers.cycles));
+		emulatorGetRegisters(emulator, &registers);
+		run++;
+	}
+	replays++;
+
+	if(emulatorReplayDiverged(emulator) || !sameState(emulator, recorded)) {
+		emulatorGetRegisters(recorded, &recorded_registers);
+		printf("%s: replay ends at pc %x after %lld cycles%s, recording at pc %x after %lld\n", name, registers.pc, registers.cycles,
+			(emulatorReplayDiverged(emulator) ? " (diverged)" : ""), recorded_registers.pc, recorded_registers.cycles);
+		differences++;
+	}
+	emulatorStopReplay(emulator);
+	emulatorDestroy(emulator);
+}
+
+int main(int argc, char *argv[]) {
+	static const long long single[] = { 0 };
+	unsigned int seed = 1;
+	MemoryHook device = { readRandom, NULL, &seed };
+	EmulatorRegisters registers;
+	int run;
+
+	FILE *file = tmpfile();
+	Emulator *emulator = createWithDevice(&device);
+	if(file == NULL || emulator == NULL) {
+		printf("Can't open a temporary file or create the emulator.\n");
+		return 1;
+	}
+	emulatorWriteMemory(emulator, program, CHECK_ORIGIN, sizeof(program));
+	emulatorGetRegisters(emulator, &registers);
+	registers.pc = CHECK_ORIGIN;
+	emulatorSetRegisters(emulator, &registers);
+
+	if(emulatorRecord(emulator, file) < 0) {
+		printf("Can't record.\n");
+		return 1;
+	}
+	for(run = 0; run < (int)(sizeof(recordLengths) / sizeof(recordLengths[0])); run++) {
+		if(run > 0) {
+			changeFromHost(emulator, run);
+		}
+		emulatorRun(emulator, recordLengths[run]);
+	}
+	emulatorStopReplay(emulator);
+	emulatorGetRegisters(emulator, &registers);
+
+	checkReplay("one run", file, emulator, registers.cycles, single, 1);
+	checkReplay("other runs", file, emulator, registers.cycles, replayLengths, (int)(sizeof(replayLengths) / sizeof(replayLengths[0])));
+
+	emulatorDestroy(emulator);
+	fclose(file);
+	printf("REPLAYCHECK: %i replays, %i differences\n", replays, differences);
+	return differences == 0 ? 0 : 1;
+}
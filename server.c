@@ -0,0 +1,351 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include "cpu.h"
+#include "memory.h"
+#include "counters.h"
+
+// Runs guest jobs for other processes over a Unix socket: ./6502_server path [workers [counters]]
+//
+// A client sends batches and reads back one result per job, in order. All fields are 32 bit
+// (64 bit for cycles) in host byte order:
+//   batch:  job count, then the jobs
+//   job:    pc, flags (JOB_65C02, JOB_UNDOCUMENTED), cycle budget (64 bit), write count, read count,
+//           writes (start, length, bytes) into zeroed memory, then reads (start, length)
+//   result: JobResult, then the bytes of every read in order
+// Jobs run until the budget is spent or an unknown opcode jams the CPU (the server keeps going).
+// Each worker thread owns a MemoryPool of pre-faulted CPUs: write payloads are received straight into guest
+// memory and results are sent with writev straight out of it, so nothing is copied on the way.
+// A malformed job closes the connection, after the results of the jobs before it in its batch.
+// With a counters name, every worker publishes live counters to its own slot of that shared memory segment
+// (see counters.h, read them with 6502_monitor) after each round of results.
+
+#define SERVER_WORKERS 4
+#define SERVER_POOL_SIZE 64 // CPUs per worker, so at most this many jobs are answered per writev round
+#define SERVER_MAX_READS 256 // per job
+#define SERVER_BUFFER_SIZE 65536
+#define SERVER_MAX_IOVECS 1024
+#define SERVER_ACCEPT_BACKOFF 10000 // microseconds a worker waits after accept fails for lack of descriptors or memory
+
+#define JOB_65C02 0x1
+#define JOB_UNDOCUMENTED 0x2
+
+#define JOB_DONE 0 // budget spent
+#define JOB_JAMMED 1 // stopped on an unknown opcode
+
+typedef struct {
+	unsigned int status;
+	unsigned int pc;
+	unsigned char a, x, y, sp, ps, padding[3];
+	unsigned long long cycles;
+} JobResult;
+
+typedef struct {
+	int start;
+	int length;
+} Region;
+
+typedef struct {
+	CPU *cpu;
+	JobResult result;
+	int readCount;
+	Region reads[SERVER_MAX_READS];
+} Job;
+
+typedef struct {
+	int file;
+	int start, end; // unread bytes in buffer
+	unsigned char buffer[SERVER_BUFFER_SIZE];
+} Connection;
+
+typedef struct {
+	int listenFile;
+	MemoryPool pool;
+	Job jobs[SERVER_POOL_SIZE];
+	Connection connection;
+	CounterSegment *counters; // NULL when not publishing
+	int index;
+	CounterValues pending; // not published yet
+} Worker;
+
+// buffered for the small fields, large payloads go from the socket straight to destination
+static int readExactly(Connection *connection, void *destination, size_t length) {
+	unsigned char *bytes = destination;
+
+	while(length > 0) {
+		if(connection->start < connection->end) {
+			size_t available = connection->end - connection->start;
+			size_t count = (length < available ? length : available);
+			memcpy(bytes, connection->buffer + connection->start, count);
+			connection->start += count;
+			bytes += count;
+			length -= count;
+		} else if(length >= SERVER_BUFFER_SIZE / 4) {
+			ssize_t result = recv(connection->file, bytes, length, MSG_WAITALL);
+			if(result <= 0) {
+				return -1;
+			}
+			bytes += result;
+			length -= result;
+		} else {
+			ssize_t result = recv(connection->file, connection->buffer, SERVER_BUFFER_SIZE, 0);
+			if(result <= 0) {
+				return -1;
+			}
+			connection->start = 0;
+			connection->end = result;
+		}
+	}
+
+	return 0;
+}
+
+static int readUnsigned(Connection *connection, unsigned int *value) {
+	return readExactly(connection, value, sizeof(*value));
+}
+
+static int writeAll(int file, struct iovec *vectors, int count) {
+	while(count > 0) {
+		ssize_t written = writev(file, vectors, count);
+		if(written < 0) {
+			return -1;
+		}
+		while(count > 0 && (size_t)written >= vectors->iov_len) { // skip what went out, resume inside a partial one
+			written -= vectors->iov_len;
+			vectors++;
+			count--;
+		}
+		if(count > 0) {
+			vectors->iov_base = (char *)vectors->iov_base + written;
+			vectors->iov_len -= written;
+		}
+	}
+	return 0;
+}
+
+static int isRegion(unsigned int start, unsigned int length) {
+	return start <= MEMORY_SIZE && length <= MEMORY_SIZE - start;
+}
+
+// loads the job into a fresh CPU and runs it; -1 if the request is malformed
+static int runJob(Worker *worker, Job *job) {
+	Connection *connection = &worker->connection;
+	unsigned int pc, flags, write_count, read_count, start, length, i;
+	unsigned long long budget;
+	CPU *cpu = job->cpu;
+
+	if(readUnsigned(connection, &pc) < 0 || readUnsigned(connection, &flags) < 0 || readExactly(connection, &budget, sizeof(budget)) < 0 ||
+		readUnsigned(connection, &write_count) < 0 || readUnsigned(connection, &read_count) < 0 || read_count > SERVER_MAX_READS) {
+		return -1;
+	}
+
+	for(i = 0; i < write_count; i++) {
+		if(readUnsigned(connection, &start) < 0 || readUnsigned(connection, &length) < 0 || !isRegion(start, length) ||
+			readExactly(connection, cpu->ram + start, length) < 0) { // pooled CPUs map ram in order, so this is guest memory
+			return -1;
+		}
+	}
+	job->readCount = read_count;
+	for(i = 0; i < read_count; i++) {
+		if(readUnsigned(connection, &start) < 0 || readUnsigned(connection, &length) < 0 || !isRegion(start, length)) {
+			return -1;
+		}
+		job->reads[i].start = start;
+		job->reads[i].length = length;
+	}
+
+	cpu->pc = pc & 0xFFFF;
+	cpu->variant = (flags & JOB_65C02 ? CPU_65C02 : CPU_NMOS);
+	cpu->undocumentedOpcodes = (flags & JOB_UNDOCUMENTED) != 0;
+	cpu->jamOnUnknownOpcode = 1;
+	unsigned long instructions = 0;
+	if(cpu->variant == CPU_65C02) {
+		while((unsigned long long)cpu->cycles < budget && !cpu->jammed) {
+			step65C02(cpu);
+			instructions++;
+		}
+	} else {
+		while((unsigned long long)cpu->cycles < budget && !cpu->jammed) {
+			stepNMOS(cpu);
+			instructions++;
+		}
+	}
+
+	worker->pending.instructions += instructions;
+	worker->pending.cycles += cpu->cycles;
+	worker->pending.pageCrossings += cpu->pageCrossings;
+	worker->pending.faults += cpu->jammed;
+	worker->pending.runs++;
+
+	job->result.status = (cpu->jammed ? JOB_JAMMED : JOB_DONE);
+	job->result.pc = cpu->pc;
+	job->result.a = cpu->a;
+	job->result.x = cpu->x;
+	job->result.y = cpu->y;
+	job->result.sp = cpu->sp;
+	job->result.ps = cpu->ps;
+	job->result.cycles = cpu->cycles;
+	return 0;
+}
+
+// results go out from the job structs and guest memory, in as few writev calls as IOV_MAX allows
+static int sendResults(Worker *worker, int job_count) {
+	struct iovec vectors[SERVER_MAX_IOVECS];
+	int count = 0;
+	int i, j;
+
+	for(i = 0; i < job_count; i++) {
+		Job *job = &worker->jobs[i];
+		if(count + 1 + job->readCount > SERVER_MAX_IOVECS) {
+			if(writeAll(worker->connection.file, vectors, count) < 0) {
+				return -1;
+			}
+			count = 0;
+		}
+		vectors[count].iov_base = &job->result;
+		vectors[count++].iov_len = sizeof(job->result);
+		for(j = 0; j < job->readCount; j++) {
+			vectors[count].iov_base = job->cpu->ram + job->reads[j].start;
+			vectors[count++].iov_len = job->reads[j].length;
+		}
+	}
+
+	return writeAll(worker->connection.file, vectors, count);
+}
+
+static int runBatch(Worker *worker) {
+	unsigned int job_count;
+
+	if(readUnsigned(&worker->connection, &job_count) < 0) {
+		return -1;
+	}
+
+	while(job_count > 0) {
+		int count = (job_count < SERVER_POOL_SIZE ? job_count : SERVER_POOL_SIZE);
+		int i, failed = 0;
+
+		for(i = 0; i < count && !failed; i++) {
+			worker->jobs[i].cpu = allocateCPU(&worker->pool);
+			failed = runJob(worker, &worker->jobs[i]) < 0;
+		}
+		// a malformed job still gets the jobs before it answered, then closes the connection
+		if(sendResults(worker, (failed ? i - 1 : i)) < 0) {
+			failed = 1;
+		}
+		if(worker->counters != NULL) {
+			addCounters(worker->counters, worker->index, &worker->pending);
+			memset(&worker->pending, 0, sizeof(worker->pending));
+		}
+		while(i > 0) {
+			releaseCPU(&worker->pool, worker->jobs[--i].cpu);
+		}
+		if(failed) {
+			return -1;
+		}
+		job_count -= count;
+	}
+
+	return 0;
+}
+
+static void *runWorker(void *context) {
+	Worker *worker = context;
+
+	for(;;) {
+		int file = accept(worker->listenFile, NULL, NULL);
+		if(file < 0) {
+			if(errno != EINTR) {
+				usleep(SERVER_ACCEPT_BACKOFF); // EMFILE, ENFILE, ENOBUFS... retrying right away would only spin
+			}
+			continue;
+		}
+
+		worker->connection.file = file;
+		worker->connection.start = worker->connection.end = 0;
+		while(runBatch(worker) == 0);
+		close(file);
+	}
+
+	return NULL;
+}
+
+static int prewarmPool(MemoryPool *pool) {
+	CPU *cpus[SERVER_POOL_SIZE];
+	int i;
+
+	if(initializeMemoryPool(pool, SERVER_POOL_SIZE) < 0) {
+		return -1;
+	}
+	for(i = 0; i < SERVER_POOL_SIZE; i++) { // touches every page once, so the first jobs don't pay the page faults
+		cpus[i] = allocateCPU(pool);
+	}
+	for(i = SERVER_POOL_SIZE - 1; i >= 0; i--) {
+		releaseCPU(pool, cpus[i]);
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[]) {
+	struct sockaddr_un address;
+	int workers = SERVER_WORKERS;
+	CounterSegment *counters = NULL;
+	int i;
+
+	if(argc < 2 || argc > 4) {
+		printf("Usage: %s socket [workers [counters]]\n", argv[0]);
+		return -1;
+	}
+	if(argc >= 3) {
+		workers = atoi(argv[2]);
+	}
+	if(workers < 1 || strlen(argv[1]) >= sizeof(address.sun_path)) {
+		printf("Bad socket path or worker count.\n");
+		return -1;
+	}
+
+	if(argc == 4 && (counters = createCounterSegment(argv[3], workers)) == NULL) {
+		printf("Can't create counters %s.\n", argv[3]);
+		return -1;
+	}
+
+	signal(SIGPIPE, SIG_IGN); // a client going away only ends its connection
+
+	int listen_file = socket(AF_UNIX, SOCK_STREAM, 0);
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, argv[1]);
+	unlink(argv[1]);
+	if(listen_file < 0 || bind(listen_file, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(listen_file, 64) < 0) {
+		perror("socket");
+		return -1;
+	}
+
+	Worker *pool = calloc(workers, sizeof(Worker));
+	pthread_t *threads = malloc(sizeof(pthread_t) * workers);
+	if(pool == NULL || threads == NULL) {
+		printf("Out of memory.\n");
+		return -1;
+	}
+	for(i = 0; i < workers; i++) {
+		pool[i].listenFile = listen_file;
+		pool[i].counters = counters;
+		pool[i].index = i;
+		if(prewarmPool(&pool[i].pool) < 0 || pthread_create(&threads[i], NULL, runWorker, &pool[i]) != 0) {
+			printf("Can't start worker %i.\n", i);
+			return -1;
+		}
+	}
+
+	printf("Serving on %s with %i workers.\n", argv[1], workers);
+	for(i = 0; i < workers; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	return 0;
+}
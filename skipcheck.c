@@ -0,0 +1,206 @@
+#include <stdio.h>
+#include <string.h>
+#include "cpu.h"
+#include "emulator.h"
+
+// Differential check of emulatorRun's shortcuts: idle loop skipping (idle.h) and loops run as host code (idioms.h)
+// must leave exactly what running every instruction leaves. Every workload runs on two emulators, one skipping
+// and one not, in the same series of runs of odd lengths (so they stop inside loops too), with the same host
+// writes between some of them; after every run both need the same registers, cycles, memory and page crossings.
+// Both variants, with instruction fusion on and off.
+
+#define DATA_START 0x2200 // a pattern every workload finds there
+#define DATA_LENGTH 0x200
+#define MAX_POKES 4
+
+typedef struct {
+	int run; // written before that run
+	int address;
+	unsigned char value;
+} Poke;
+
+typedef struct {
+	const char *name;
+	int origin;
+	unsigned char code[48];
+	int length;
+	Poke pokes[MAX_POKES];
+} Workload;
+
+static const Workload workloads[] = {
+	{ "delay", 0x04FC, {
+		0xA2, 0x00,       // LDX #0
+		0xCA,             // DEX
+		0xD0, 0xFD,       // BNE -3 (across the page)
+		0xA0, 0x00,       // LDY #0
+		0xC8,             // INY
+		0xD0, 0xFD,       // BNE -3
+		0xA0, 0x40,       // LDY #$40
+		0xA2, 0x00,       // LDX #0
+		0xE8,             // INX
+		0xD0, 0xFD,       // BNE -3
+		0x88,             // DEY
+		0xD0, 0xF8,       // BNE -8
+		0x4C, 0x10, 0x05, // JMP $0510
+	}, 23, { { -1 } } },
+	{ "polling", 0x0400, {
+		0xA2, 0x80,       // LDX #$80
+		0xBD, 0xF0, 0x20, // LDA $20F0,X (across the page)
+		0x29, 0x01,       // AND #$01
+		0xF0, 0xF9,       // BEQ -7
+		0x24, 0x10,       // BIT $10
+		0x10, 0xFC,       // BPL -4
+		0xA9, 0x00,       // LDA #0
+		0x4C, 0x0F, 0x04, // JMP $040F
+	}, 18, { { 6, 0x2170, 0x01 }, { 10, 0x10, 0x80 }, { -1 } } },
+	{ "fill", 0x0400, {
+		0xA9, 0xAA,       // LDA #$AA
+		0xA2, 0x00,       // LDX #0
+		0x9D, 0x00, 0x30, // STA $3000,X
+		0xE8,             // INX
+		0xD0, 0xFA,       // BNE -6
+		0xA9, 0xF0,       // LDA #$F0
+		0x85, 0x20,       // STA $20
+		0xA9, 0x31,       // LDA #$31
+		0x85, 0x21,       // STA $21
+		0xA9, 0x55,       // LDA #$55
+		0xA0, 0x80,       // LDY #$80
+		0x91, 0x20,       // STA ($20),Y (across the page)
+		0x88,             // DEY
+		0xD0, 0xFB,       // BNE -5
+		0x4C, 0x1B, 0x04, // JMP $041B
+	}, 30, { { -1 } } },
+	{ "copy", 0x0400, {
+		0xA0, 0x00,       // LDY #0
+		0xB9, 0x80, 0x22, // LDA $2280,Y (across the page from Y = $80)
+		0x99, 0x00, 0x34, // STA $3400,Y
+		0xC8,             // INY
+		0xD0, 0xF7,       // BNE -9
+		0xA2, 0xFF,       // LDX #$FF
+		0xBD, 0x00, 0x22, // LDA $2200,X
+		0x9D, 0x01, 0x22, // STA $2201,X (overlapping)
+		0xCA,             // DEX
+		0xD0, 0xF7,       // BNE -9
+		0x4C, 0x16, 0x04, // JMP $0416
+	}, 25, { { -1 } } },
+	{ "multiply", 0x04F0, {
+		0xA9, 0x00,       // LDA #0
+		0xA2, 0x08,       // LDX #8
+		0x46, 0x11,       // LSR $11
+		0xEA, 0xEA,       // NOP, NOP
+		0x90, 0x03,       // BCC +3
+		0x18,             // CLC
+		0x65, 0x10,       // ADC $10
+		0x6A,             // ROR A
+		0x66, 0x11,       // ROR $11
+		0xCA,             // DEX
+		0xD0, 0xF5,       // BNE -11 (across the page)
+		0x85, 0x12,       // STA $12
+		0xE6, 0x10,       // INC $10
+		0xC6, 0x13,       // DEC $13
+		0xD0, 0xE5,       // BNE -27
+		0x4C, 0x0B, 0x05, // JMP $050B
+	}, 30, { { 0, 0x10, 0x5B }, { 0, 0x11, 0xC7 }, { 0, 0x13, 0x40 }, { -1 } } },
+};
+
+static const long long runLengths[] = { 1, 2, 5, 13, 100, 777, 4000, 25000, 3, 100000, 17, 250000, 64, 9999 };
+
+static int runs = 0;
+static int differences = 0;
+
+static Emulator *createFor(const Workload *workload, int variant, int fuse, int skip) {
+	unsigned char data[DATA_LENGTH];
+	int i;
+
+	Emulator *emulator = emulatorCreateVariant(variant);
+	if(emulator == NULL) {
+		return NULL;
+	}
+	for(i = 0; i < DATA_LENGTH; i++) {
+		data[i] = i * 7 + 3;
+	}
+	emulatorWriteMemory(emulator, data, DATA_START, DATA_LENGTH);
+	emulatorWriteMemory(emulator, workload->code, workload->origin, workload->length);
+	emulatorSetInstructionFusion(emulator, fuse);
+	emulatorSetIdleLoopSkipping(emulator, skip);
+
+	EmulatorRegisters registers;
+	emulatorGetRegisters(emulator, &registers);
+	registers.pc = workload->origin;
+	emulatorSetRegisters(emulator, &registers);
+	return emulator;
+}
+
+static void poke(Emulator *emulator, const Workload *workload, int run) {
+	int i;
+	for(i = 0; i < MAX_POKES && workload->pokes[i].run >= 0; i++) {
+		if(workload->pokes[i].run == run) {
+			emulatorWriteMemory(emulator, &workload->pokes[i].value, workload->pokes[i].address, 1);
+		}
+	}
+}
+
+static int sameState(Emulator *first, Emulator *second) {
+	static unsigned char first_memory[MEMORY_SIZE], second_memory[MEMORY_SIZE];
+	EmulatorRegisters first_registers, second_registers;
+
+	emulatorGetRegisters(first, &first_registers);
+	emulatorGetRegisters(second, &second_registers);
+	emulatorReadMemory(first, first_memory, 0, MEMORY_SIZE);
+	emulatorReadMemory(second, second_memory, 0, MEMORY_SIZE);
+	return first_registers.pc == second_registers.pc && first_registers.sp == second_registers.sp && first_registers.a == second_registers.a &&
+		first_registers.x == second_registers.x && first_registers.y == second_registers.y && first_registers.ps == second_registers.ps &&
+		first_registers.cycles == second_registers.cycles && emulatorGetCPU(first)->pageCrossings == emulatorGetCPU(second)->pageCrossings &&
+		memcmp(first_memory, second_memory, MEMORY_SIZE) == 0;
+}
+
+static void checkWorkload(const Workload *workload, int variant, int fuse) {
+	const char *variant_name = (variant == EMULATOR_65C02 ? "65C02" : "NMOS");
+	int run;
+
+	Emulator *skipping = createFor(workload, variant, fuse, 1);
+	Emulator *stepping = createFor(workload, variant, fuse, 0);
+	if(skipping == NULL || stepping == NULL) {
+		printf("%s: can't create the emulators\n", workload->name);
+		differences++;
+		emulatorDestroy(skipping);
+		emulatorDestroy(stepping);
+		return;
+	}
+
+	for(run = 0; run < (int)(sizeof(runLengths) / sizeof(runLengths[0])); run++) {
+		poke(skipping, workload, run);
+		poke(stepping, workload, run);
+		long long skipped = emulatorRun(skipping, runLengths[run]);
+		long long stepped = emulatorRun(stepping, runLengths[run]);
+		runs++;
+
+		if(skipped != stepped || !sameState(skipping, stepping)) {
+			EmulatorRegisters skipping_registers, stepping_registers;
+			emulatorGetRegisters(skipping, &skipping_registers);
+			emulatorGetRegisters(stepping, &stepping_registers);
+			printf("%s (%s%s), run %i: skipping ends at pc %x after %lld cycles (%lu page crossings), stepping at pc %x after %lld (%lu)\n",
+				workload->name, variant_name, (fuse ? ", fused" : ""), run, skipping_registers.pc, skipping_registers.cycles,
+				emulatorGetCPU(skipping)->pageCrossings, stepping_registers.pc, stepping_registers.cycles, emulatorGetCPU(stepping)->pageCrossings);
+			differences++;
+			break;
+		}
+	}
+
+	emulatorDestroy(skipping);
+	emulatorDestroy(stepping);
+}
+
+int main(int argc, char *argv[]) {
+	int i, fuse;
+
+	for(fuse = 0; fuse <= 1; fuse++) {
+		for(i = 0; i < (int)(sizeof(workloads) / sizeof(workloads[0])); i++) {
+			checkWorkload(&workloads[i], EMULATOR_NMOS, fuse);
+			checkWorkload(&workloads[i], EMULATOR_65C02, fuse);
+		}
+	}
+
+	printf("SKIPCHECK: %i runs, %i differences\n", runs, differences);
+	return differences == 0 ? 0 : 1;
+}
@@ -1,5 +1,7 @@
 #include <stdio.h>
 #include "cpu.h"
+#include "heatmap.h"
+#include "coverage.h"
 
 int readFileBytes(const char *name, char **program)
 {
@@ -20,10 +22,17 @@ int main(int argc, char *argv[]) {
 	// const char program[] = { 0xC8, 0x20, 0x00, 0x00 };
 	// const char program[] = { 0xA2, 0x01, 0x86, 0x00, 0x38, 0xA0, 0x07, 0x98, 0xE9, 0x03, 0xA8, 0x18, 0xA9, 0x02, 0x85, 0x01, 0xA6, 0x01, 0x65, 0x00, 0x85, 0x01, 0x86, 0x00, 0x88, 0xD0, 0xF5 };
 
+#ifdef COVERAGE
+	if(argc != 2 && argc != 3) {
+		printf("Usage: %s program [listing]\n", argv[0]);
+		return -1;
+	}
+#else
 	if(argc != 2) {
 		printf("Usage: %s program \n", argv[0]);
 		return -1;
 	}
+#endif
 
 	char *program;
 	int program_length = readFileBytes(argv[1], &program);
@@ -39,6 +48,14 @@ int main(int argc, char *argv[]) {
 
 	CPU cpu;
 	initializeCPU(&cpu);
+#ifdef HEATMAP
+	Heatmap *heatmap = createHeatmap();
+	cpu.heatmap = heatmap;
+#endif
+#ifdef COVERAGE
+	Coverage *coverage = createCoverage();
+	cpu.coverage = coverage;
+#endif
 
 	cpu.pc = 0x4000;
 	writeMemory(&cpu, program, cpu.pc, program_length);
@@ -87,19 +104,49 @@ int main(int argc, char *argv[]) {
 
 	printMemory(&cpu);
 
+#ifdef HEATMAP
+	writeHeatmapReport(heatmap, stdout, 10);
+	FILE *matrix = fopen("heatmap.bin", "wb");
+	if(matrix == NULL || writeHeatmapMatrix(heatmap, matrix) != 0) {
+		printf("Can't write heatmap.bin.\n");
+	}
+	if(matrix != NULL) {
+		fclose(matrix);
+	}
+	freeHeatmap(heatmap);
+#endif
+#ifdef COVERAGE
+	CoverageMap *coverage_map = createCoverageMap();
+	FILE *listing = (argc == 3 ? fopen(argv[2], "r") : NULL);
+	if(listing != NULL) {
+		printf("COVERAGE: %i addresses mapped from %s\n", loadCoverageListing(coverage_map, listing, argv[2]), argv[2]);
+		fclose(listing);
+	}
+	FILE *info = fopen("coverage.info", "w");
+	if(info == NULL || writeCoverageLcov(coverage, coverage_map, &cpu, info, "test") != 0) {
+		printf("Can't write coverage.info.\n");
+	}
+	if(info != NULL) {
+		fclose(info);
+	}
+	freeCoverageMap(coverage_map);
+	freeCoverage(coverage);
+#endif
+
 	printf("### results:\n");
 	printf("cpu->sp: %x\n", cpu.sp);
 	printf("cpu->a: %x\n", cpu.a);
 	printf("cpu->x: %x\n", cpu.x);
 	printf("cpu->y: %x\n", cpu.y);
 	printf("cpu->ps: %x\n", cpu.ps);
-	printf("cpu->cycles: %i\n", cpu.cycles);
+	printf("cpu->cycles: %lli\n", cpu.cycles);
 	// printf("%s\n", );
 	// printbitssimple(cpu.ps);	
-	printf("MEMORY 9: %x\n", *cpu.memory[0x80]);
-	printf("MEMORY final: %x\n", *cpu.memory[0x0210]);
+	printf("MEMORY 9: %x\n", *memoryByte(&cpu, 0x80));
+	printf("MEMORY final: %x\n", *memoryByte(&cpu, 0x0210));
 
 	freeCPU(&cpu);
+	free(program);
 
 	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,319 @@
+#include <stdio.h>
+#include <string.h>
+#include "cpu.h"
+
+// Cycle count check for every documented opcode of the NMOS 6502 and the 65C02 against the published timing tables.
+// Each instruction runs once without crossing a page and once crossing one: opcodes with a page penalty
+// must take one more cycle when they cross, every other one the same. Branches are checked untaken,
+// taken on the same page and taken across a page, forwards and backwards.
+// The stable undocumented NMOS opcodes get the same cycle checks, and the ones that combine two operations a check of
+// their result and flags as well (with ADC and SBC, which two of them end in).
+// Everything runs a second time through the fused step functions (stepFusedNMOS, stepFused65C02), which have to
+// give the same counts for single instructions, and the pairs they fuse have to take the cycles of both halves.
+// Build with CYCLE_EXACT=1 to check the cycle-stepped core (where every bus access, dummy ones included, is a cycle).
+
+typedef struct {
+	unsigned char opcode;
+	int cycles;
+	int pagePenalty; // +1 when indexing crosses a page
+} Timing;
+
+// the same on both variants
+static const Timing timings[] = {
+	{ 0x69, 2, 0 }, { 0x65, 3, 0 }, { 0x75, 4, 0 }, { 0x6D, 4, 0 }, { 0x7D, 4, 1 }, { 0x79, 4, 1 }, { 0x61, 6, 0 }, { 0x71, 5, 1 }, // ADC
+	{ 0x29, 2, 0 }, { 0x25, 3, 0 }, { 0x35, 4, 0 }, { 0x2D, 4, 0 }, { 0x3D, 4, 1 }, { 0x39, 4, 1 }, { 0x21, 6, 0 }, { 0x31, 5, 1 }, // AND
+	{ 0x0A, 2, 0 }, { 0x06, 5, 0 }, { 0x16, 6, 0 }, { 0x0E, 6, 0 }, // ASL
+	{ 0x24, 3, 0 }, { 0x2C, 4, 0 }, // BIT
+	{ 0x00, 7, 0 }, // BRK
+	{ 0x18, 2, 0 }, { 0xD8, 2, 0 }, { 0x58, 2, 0 }, { 0xB8, 2, 0 }, // CLC, CLD, CLI, CLV
+	{ 0xC9, 2, 0 }, { 0xC5, 3, 0 }, { 0xD5, 4, 0 }, { 0xCD, 4, 0 }, { 0xDD, 4, 1 }, { 0xD9, 4, 1 }, { 0xC1, 6, 0 }, { 0xD1, 5, 1 }, // CMP
+	{ 0xE0, 2, 0 }, { 0xE4, 3, 0 }, { 0xEC, 4, 0 }, // CPX
+	{ 0xC0, 2, 0 }, { 0xC4, 3, 0 }, { 0xCC, 4, 0 }, // CPY
+	{ 0xC6, 5, 0 }, { 0xD6, 6, 0 }, { 0xCE, 6, 0 }, { 0xDE, 7, 0 }, // DEC
+	{ 0xCA, 2, 0 }, { 0x88, 2, 0 }, // DEX, DEY
+	{ 0x49, 2, 0 }, { 0x45, 3, 0 }, { 0x55, 4, 0 }, { 0x4D, 4, 0 }, { 0x5D, 4, 1 }, { 0x59, 4, 1 }, { 0x41, 6, 0 }, { 0x51, 5, 1 }, // EOR
+	{ 0xE6, 5, 0 }, { 0xF6, 6, 0 }, { 0xEE, 6, 0 }, { 0xFE, 7, 0 }, // INC
+	{ 0xE8, 2, 0 }, { 0xC8, 2, 0 }, // INX, INY
+	{ 0x4C, 3, 0 }, // JMP
+	{ 0x20, 6, 0 }, // JSR
+	{ 0xA9, 2, 0 }, { 0xA5, 3, 0 }, { 0xB5, 4, 0 }, { 0xAD, 4, 0 }, { 0xBD, 4, 1 }, { 0xB9, 4, 1 }, { 0xA1, 6, 0 }, { 0xB1, 5, 1 }, // LDA
+	{ 0xA2, 2, 0 }, { 0xA6, 3, 0 }, { 0xB6, 4, 0 }, { 0xAE, 4, 0 }, { 0xBE, 4, 1 }, // LDX
+	{ 0xA0, 2, 0 }, { 0xA4, 3, 0 }, { 0xB4, 4, 0 }, { 0xAC, 4, 0 }, { 0xBC, 4, 1 }, // LDY
+	{ 0x4A, 2, 0 }, { 0x46, 5, 0 }, { 0x56, 6, 0 }, { 0x4E, 6, 0 }, // LSR
+	{ 0xEA, 2, 0 }, // NOP
+	{ 0x09, 2, 0 }, { 0x05, 3, 0 }, { 0x15, 4, 0 }, { 0x0D, 4, 0 }, { 0x1D, 4, 1 }, { 0x19, 4, 1 }, { 0x01, 6, 0 }, { 0x11, 5, 1 }, // ORA
+	{ 0x48, 3, 0 }, { 0x08, 3, 0 }, { 0x68, 4, 0 }, { 0x28, 4, 0 }, // PHA, PHP, PLA, PLP
+	{ 0x2A, 2, 0 }, { 0x26, 5, 0 }, { 0x36, 6, 0 }, { 0x2E, 6, 0 }, // ROL
+	{ 0x6A, 2, 0 }, { 0x66, 5, 0 }, { 0x76, 6, 0 }, { 0x6E, 6, 0 }, // ROR
+	{ 0x40, 6, 0 }, { 0x60, 6, 0 }, // RTI, RTS
+	{ 0xE9, 2, 0 }, { 0xE5, 3, 0 }, { 0xF5, 4, 0 }, { 0xED, 4, 0 }, { 0xFD, 4, 1 }, { 0xF9, 4, 1 }, { 0xE1, 6, 0 }, { 0xF1, 5, 1 }, // SBC
+	{ 0x38, 2, 0 }, { 0xF8, 2, 0 }, { 0x78, 2, 0 }, // SEC, SED, SEI
+	{ 0x85, 3, 0 }, { 0x95, 4, 0 }, { 0x8D, 4, 0 }, { 0x9D, 5, 0 }, { 0x99, 5, 0 }, { 0x81, 6, 0 }, { 0x91, 6, 0 }, // STA
+	{ 0x86, 3, 0 }, { 0x96, 4, 0 }, { 0x8E, 4, 0 }, // STX
+	{ 0x84, 3, 0 }, { 0x94, 4, 0 }, { 0x8C, 4, 0 }, // STY
+	{ 0xAA, 2, 0 }, { 0xA8, 2, 0 }, { 0xBA, 2, 0 }, { 0x8A, 2, 0 }, { 0x9A, 2, 0 }, { 0x98, 2, 0 }, // TAX, TAY, TSX, TXA, TXS, TYA
+};
+
+static const Timing timingsNMOS[] = {
+	{ 0x1E, 7, 0 }, { 0x5E, 7, 0 }, { 0x3E, 7, 0 }, { 0x7E, 7, 0 }, // ASL, LSR, ROL, ROR abs,X
+	{ 0x6C, 5, 0 }, // JMP (abs)
+};
+
+static const Timing timings65C02[] = {
+	{ 0x72, 5, 0 }, { 0x32, 5, 0 }, { 0xD2, 5, 0 }, { 0x52, 5, 0 }, { 0xB2, 5, 0 }, { 0x12, 5, 0 }, { 0xF2, 5, 0 }, { 0x92, 5, 0 }, // (zpg)
+	{ 0x1E, 6, 1 }, { 0x5E, 6, 1 }, { 0x3E, 6, 1 }, { 0x7E, 6, 1 }, // ASL, LSR, ROL, ROR abs,X
+	{ 0x89, 2, 0 }, { 0x34, 4, 0 }, { 0x3C, 4, 1 }, // BIT
+	{ 0x1A, 2, 0 }, { 0x3A, 2, 0 }, // INC A, DEC A
+	{ 0x6C, 6, 0 }, { 0x7C, 6, 0 }, // JMP (abs), JMP (abs,X)
+	{ 0xDA, 3, 0 }, { 0x5A, 3, 0 }, { 0xFA, 4, 0 }, { 0x7A, 4, 0 }, // PHX, PHY, PLX, PLY
+	{ 0x64, 3, 0 }, { 0x74, 4, 0 }, { 0x9C, 4, 0 }, { 0x9E, 5, 0 }, // STZ
+	{ 0x14, 5, 0 }, { 0x1C, 6, 0 }, { 0x04, 5, 0 }, { 0x0C, 6, 0 }, // TRB, TSB
+};
+
+// NMOS with undocumentedOpcodes on
+static const Timing timingsUndocumented[] = {
+	{ 0x4B, 2, 0 }, { 0x0B, 2, 0 }, { 0x2B, 2, 0 }, { 0x6B, 2, 0 }, { 0xCB, 2, 0 }, { 0xEB, 2, 0 }, // ALR, ANC, ARR, SBX, SBC
+	{ 0xC7, 5, 0 }, { 0xD7, 6, 0 }, { 0xCF, 6, 0 }, { 0xDF, 7, 0 }, { 0xDB, 7, 0 }, { 0xC3, 8, 0 }, { 0xD3, 8, 0 }, // DCP
+	{ 0xE7, 5, 0 }, { 0xF7, 6, 0 }, { 0xEF, 6, 0 }, { 0xFF, 7, 0 }, { 0xFB, 7, 0 }, { 0xE3, 8, 0 }, { 0xF3, 8, 0 }, // ISC
+	{ 0xA7, 3, 0 }, { 0xB7, 4, 0 }, { 0xAF, 4, 0 }, { 0xBF, 4, 1 }, { 0xA3, 6, 0 }, { 0xB3, 5, 1 }, // LAX
+	{ 0x1A, 2, 0 }, { 0x3A, 2, 0 }, { 0x5A, 2, 0 }, { 0x7A, 2, 0 }, { 0xDA, 2, 0 }, { 0xFA, 2, 0 }, // NOP
+	{ 0x80, 2, 0 }, { 0x82, 2, 0 }, { 0x89, 2, 0 }, { 0xC2, 2, 0 }, { 0xE2, 2, 0 }, // NOP #imm
+	{ 0x04, 3, 0 }, { 0x44, 3, 0 }, { 0x64, 3, 0 }, { 0x0C, 4, 0 }, // NOP zpg, abs
+	{ 0x14, 4, 0 }, { 0x34, 4, 0 }, { 0x54, 4, 0 }, { 0x74, 4, 0 }, { 0xD4, 4, 0 }, { 0xF4, 4, 0 }, // NOP zpg,X
+	{ 0x1C, 4, 1 }, { 0x3C, 4, 1 }, { 0x5C, 4, 1 }, { 0x7C, 4, 1 }, { 0xDC, 4, 1 }, { 0xFC, 4, 1 }, // NOP abs,X
+	{ 0x27, 5, 0 }, { 0x37, 6, 0 }, { 0x2F, 6, 0 }, { 0x3F, 7, 0 }, { 0x3B, 7, 0 }, { 0x23, 8, 0 }, { 0x33, 8, 0 }, // RLA
+	{ 0x67, 5, 0 }, { 0x77, 6, 0 }, { 0x6F, 6, 0 }, { 0x7F, 7, 0 }, { 0x7B, 7, 0 }, { 0x63, 8, 0 }, { 0x73, 8, 0 }, // RRA
+	{ 0x87, 3, 0 }, { 0x97, 4, 0 }, { 0x8F, 4, 0 }, { 0x83, 6, 0 }, // SAX
+	{ 0x07, 5, 0 }, { 0x17, 6, 0 }, { 0x0F, 6, 0 }, { 0x1F, 7, 0 }, { 0x1B, 7, 0 }, { 0x03, 8, 0 }, { 0x13, 8, 0 }, // SLO
+	{ 0x47, 5, 0 }, { 0x57, 6, 0 }, { 0x4F, 6, 0 }, { 0x5F, 7, 0 }, { 0x5B, 7, 0 }, { 0x43, 8, 0 }, { 0x53, 8, 0 }, // SRE
+};
+
+// one zero page instruction (operand at $40) and the registers and memory before and after it
+typedef struct {
+	unsigned char opcode;
+	unsigned char a, x, ps, memory;
+	unsigned char resultA, resultX, resultPs, resultMemory;
+} Result;
+
+static const Result results[] = {
+	{ 0xA7, 0x00, 0x00, 0x04, 0x80, 0x80, 0x80, 0x84, 0x80 }, // LAX: A and X loaded, N
+	{ 0xA7, 0x55, 0x55, 0x04, 0x00, 0x00, 0x00, 0x06, 0x00 }, // LAX: Z
+	{ 0x87, 0xF0, 0x3C, 0x86, 0x00, 0xF0, 0x3C, 0x86, 0x30 }, // SAX: A & X stored, flags untouched
+	{ 0xC7, 0x10, 0x00, 0x04, 0x11, 0x10, 0x00, 0x07, 0x10 }, // DCP: decremented to A, Z and C
+	{ 0xC7, 0x10, 0x00, 0x04, 0x00, 0x10, 0x00, 0x04, 0xFF }, // DCP: wraps to $FF, above A so no C
+	{ 0xE7, 0x10, 0x00, 0x05, 0x0F, 0x00, 0x00, 0x07, 0x10 }, // ISC: incremented and subtracted, Z and C
+	{ 0xE7, 0x80, 0x00, 0x05, 0x00, 0x7F, 0x00, 0x45, 0x01 }, // ISC: $80 - 1 overflows
+	{ 0x07, 0x01, 0x00, 0x04, 0x81, 0x03, 0x00, 0x05, 0x02 }, // SLO: bit 7 to C, result ORed into A
+	{ 0x27, 0xFF, 0x00, 0x05, 0x80, 0x01, 0x00, 0x05, 0x01 }, // RLA: C in and out, result ANDed into A
+	{ 0x27, 0xFF, 0x00, 0x04, 0x40, 0x80, 0x00, 0x84, 0x80 }, // RLA: N
+	{ 0x47, 0xFF, 0x00, 0x04, 0x03, 0xFE, 0x00, 0x85, 0x01 }, // SRE: bit 0 to C, result XORed into A
+	{ 0x67, 0x10, 0x00, 0x05, 0x02, 0x91, 0x00, 0x84, 0x81 }, // RRA: C rotated in, the new C added
+	{ 0x67, 0x7F, 0x00, 0x04, 0x03, 0x81, 0x00, 0xC4, 0x01 }, // RRA: C from the rotate makes the addition overflow
+	{ 0x65, 0x7F, 0x00, 0x05, 0x01, 0x81, 0x00, 0xC4, 0x01 }, // ADC: $7F + 1 + C overflows
+	{ 0xE5, 0x80, 0x00, 0x04, 0x00, 0x7F, 0x00, 0x45, 0x00 }, // SBC: $80 - 0 - borrow overflows
+};
+
+// branch opcode and the status flags that make it taken
+static const unsigned char branches[][2] = {
+	{ 0x10, 0x00 }, { 0x30, 0x80 }, { 0x50, 0x00 }, { 0x70, 0x40 }, // BPL, BMI, BVC, BVS
+	{ 0x90, 0x00 }, { 0xB0, 0x01 }, { 0xD0, 0x00 }, { 0xF0, 0x02 }, // BCC, BCS, BNE, BEQ
+};
+
+// a pair the fused step functions run from one dispatch, at pc with X and Y set to index, and the cycles of both halves
+typedef struct {
+	unsigned char code[5];
+	int pc;
+	unsigned char index;
+	int cycles;
+} Pair;
+
+static const Pair pairs[] = {
+	{ { 0xC9, 0x01, 0xD0, 0x10 }, 0x0400, 0x00, 5 }, // CMP #imm, BNE taken
+	{ { 0xC9, 0x00, 0xD0, 0x10 }, 0x0400, 0x00, 4 }, // CMP #imm, BNE untaken
+	{ { 0xC9, 0x01, 0xD0, 0x10 }, 0x04FA, 0x00, 6 }, // CMP #imm, BNE taken to the next page
+	{ { 0xCA, 0xD0, 0x10 }, 0x0400, 0x02, 5 }, { { 0xCA, 0xD0, 0x10 }, 0x0400, 0x01, 4 }, // DEX, BNE
+	{ { 0x88, 0xD0, 0x10 }, 0x0400, 0x02, 5 }, { { 0x88, 0xD0, 0x10 }, 0x0400, 0x01, 4 }, // DEY, BNE
+	{ { 0xA9, 0x55, 0x85, 0x20 }, 0x0400, 0x00, 5 }, { { 0xA9, 0x55, 0x8D, 0x00, 0x03 }, 0x0400, 0x00, 6 }, // LDA #imm, STA
+	{ { 0xA5, 0x20, 0x85, 0x21 }, 0x0400, 0x00, 6 }, { { 0xA5, 0x20, 0x8D, 0x00, 0x03 }, 0x0400, 0x00, 7 }, // LDA zpg, STA
+	{ { 0x18, 0x69, 0x01 }, 0x0400, 0x00, 4 }, { { 0x18, 0x65, 0x20 }, 0x0400, 0x00, 5 }, // CLC, ADC
+};
+
+static int failures = 0;
+static int checked = 0;
+static int undocumentedOpcodes = 0; // for the CPUs the checks run on, while the undocumented table is checked
+static int fusedStep = 0; // the checks run the variant's fused step function instead of step()
+
+// one dispatch of the variant's fused step function, returns the instructions it ran
+static int stepFused(CPU *cpu, long long end_cycles) {
+	int last_pc;
+	return cpu->variant == CPU_65C02 ? stepFused65C02(cpu, end_cycles, &last_pc) : stepFusedNMOS(cpu, end_cycles, &last_pc);
+}
+
+// runs one instruction at pc on the given variant with the given index registers and status, returns the cycles it took
+static int cyclesFor(int variant, unsigned char opcode, unsigned char operand, int pc, unsigned char index, unsigned char ps) {
+	CPU cpu;
+	initializeCPU(&cpu);
+	cpu.variant = variant;
+	cpu.undocumentedOpcodes = undocumentedOpcodes;
+
+	// operands point at $3010 (directly, or through the pointer at $10 for the indirect modes),
+	// so an index of $01 stays on the page and $F0 crosses it
+	*memoryByte(&cpu, pc) = opcode;
+	*memoryByte(&cpu, pc + 1) = operand;
+	*memoryByte(&cpu, pc + 2) = 0x30;
+	*memoryByte(&cpu, 0x10) = 0x10;
+	*memoryByte(&cpu, 0x11) = 0x30;
+
+	cpu.pc = pc;
+	cpu.x = index;
+	cpu.y = index;
+	cpu.ps = ps;
+	cpu.sp = 0xF0; // pulls have something to pull, pushes room to push
+	if(fusedStep) {
+		stepFused(&cpu, 1000); // nothing after the instruction fuses with it
+	} else {
+		step(&cpu);
+	}
+
+	int cycles = cpu.cycles;
+	freeCPU(&cpu);
+	return cycles;
+}
+
+static void expect(int variant, const char *what, unsigned char opcode, int cycles, int expected) {
+	if(cycles != expected) {
+		printf("%s%s %x (%s): %i cycles, expected %i\n", (variant == CPU_65C02 ? "65C02" : "NMOS"), (fusedStep ? " fused" : ""), opcode, what,
+			cycles, expected);
+		failures++;
+	}
+}
+
+static void checkTimings(int variant, const Timing *timings, int count) {
+	int i;
+
+	for(i = 0; i < count; i++) {
+		const Timing *timing = &timings[i];
+		expect(variant, "same page", timing->opcode, cyclesFor(variant, timing->opcode, 0x10, 0x0400, 0x01, 0x04), timing->cycles);
+		expect(variant, "page crossed", timing->opcode, cyclesFor(variant, timing->opcode, 0x10, 0x0400, 0xF0, 0x04), timing->cycles + timing->pagePenalty);
+	}
+	checked += count;
+}
+
+static void checkResult(const Result *result) {
+	CPU cpu;
+	initializeCPU(&cpu);
+	cpu.undocumentedOpcodes = 1;
+
+	*memoryByte(&cpu, 0x0400) = result->opcode;
+	*memoryByte(&cpu, 0x0401) = 0x40;
+	*memoryByte(&cpu, 0x40) = result->memory;
+	cpu.pc = 0x0400;
+	cpu.a = result->a;
+	cpu.x = result->x;
+	cpu.ps = result->ps;
+	if(fusedStep) {
+		stepFused(&cpu, 1000);
+	} else {
+		step(&cpu);
+	}
+
+	unsigned char memory = *memoryByte(&cpu, 0x40);
+	if(cpu.a != result->resultA || cpu.x != result->resultX || cpu.ps != result->resultPs || memory != result->resultMemory) {
+		printf("NMOS %x (A %x, X %x, P %x, memory %x): A %x, X %x, P %x, memory %x, expected A %x, X %x, P %x, memory %x\n",
+			result->opcode, result->a, result->x, result->ps, result->memory, cpu.a, cpu.x, cpu.ps, memory,
+			result->resultA, result->resultX, result->resultPs, result->resultMemory);
+		failures++;
+	}
+	freeCPU(&cpu);
+}
+
+static void setUpPair(CPU *cpu, int variant, const Pair *pair) {
+	initializeCPU(cpu);
+	cpu->variant = variant;
+	writeMemory(cpu, (char *)pair->code, pair->pc, sizeof(pair->code));
+	*memoryByte(cpu, 0x20) = 0x33;
+	cpu->pc = pair->pc;
+	cpu->x = pair->index;
+	cpu->y = pair->index;
+}
+
+// the pair has to run from one dispatch in the cycles of both halves and end like stepping them does,
+// and not fuse when the first half ends at end_cycles
+static void checkPair(int variant, const Pair *pair) {
+	CPU stepped, fused, stopped;
+	setUpPair(&stepped, variant, pair);
+	setUpPair(&fused, variant, pair);
+	setUpPair(&stopped, variant, pair);
+
+	step(&stepped);
+	long long first_cycles = stepped.cycles;
+	step(&stepped);
+	int instructions = stepFused(&fused, 1000);
+	int stopped_instructions = stepFused(&stopped, first_cycles);
+
+	expect(variant, "pair", pair->code[0], fused.cycles, pair->cycles);
+	expect(variant, "pair stepped", pair->code[0], stepped.cycles, pair->cycles);
+	if(instructions != 2 || stopped_instructions != 1 || fused.pc != stepped.pc || fused.a != stepped.a || fused.x != stepped.x ||
+		fused.y != stepped.y || fused.ps != stepped.ps || memcmp(fused.ram, stepped.ram, MEMORY_SIZE) != 0) {
+		printf("%s %x (pair): %i instructions, %i stopped at end_cycles, ends at pc %x, stepped at pc %x\n",
+			(variant == CPU_65C02 ? "65C02" : "NMOS"), pair->code[0], instructions, stopped_instructions, fused.pc, stepped.pc);
+		failures++;
+	}
+	checked++;
+	freeCPU(&stepped);
+	freeCPU(&fused);
+	freeCPU(&stopped);
+}
+
+// ps is the status that makes the branch taken, untaken the one that doesn't (-1 for BRA)
+static void checkBranch(int variant, unsigned char opcode, unsigned char taken, int untaken) {
+	if(untaken != -1) {
+		expect(variant, "untaken", opcode, cyclesFor(variant, opcode, 0x10, 0x0400, 0, untaken), 2);
+	}
+	expect(variant, "taken", opcode, cyclesFor(variant, opcode, 0x10, 0x0400, 0, taken), 3);
+	expect(variant, "taken backwards", opcode, cyclesFor(variant, opcode, 0xF0, 0x0480, 0, taken), 3);
+	expect(variant, "taken to next page", opcode, cyclesFor(variant, opcode, 0x20, 0x04F0, 0, taken), 4);
+	expect(variant, "taken to previous page", opcode, cyclesFor(variant, opcode, 0xE0, 0x0500, 0, taken), 4);
+	checked++;
+}
+
+static void checkVariant(int variant) {
+	int i;
+
+	checkTimings(variant, timings, (int)(sizeof(timings) / sizeof(timings[0])));
+	if(variant == CPU_65C02) {
+		checkTimings(variant, timings65C02, (int)(sizeof(timings65C02) / sizeof(timings65C02[0])));
+		checkBranch(variant, 0x80, 0x00, -1); // BRA
+	} else {
+		checkTimings(variant, timingsNMOS, (int)(sizeof(timingsNMOS) / sizeof(timingsNMOS[0])));
+		undocumentedOpcodes = 1;
+		checkTimings(variant, timingsUndocumented, (int)(sizeof(timingsUndocumented) / sizeof(timingsUndocumented[0])));
+		undocumentedOpcodes = 0;
+		for(i = 0; i < (int)(sizeof(results) / sizeof(results[0])); i++) {
+			checkResult(&results[i]);
+		}
+	}
+
+	for(i = 0; i < (int)(sizeof(branches) / sizeof(branches[0])); i++) {
+		unsigned char taken = branches[i][1];
+		checkBranch(variant, branches[i][0], taken, (taken == 0 ? 0xC3 : 0x00)); // N, V, Z and C all set when the branch wants them clear
+	}
+}
+
+int main(int argc, char *argv[]) {
+	int i;
+
+	checkVariant(CPU_NMOS);
+	checkVariant(CPU_65C02);
+
+	fusedStep = 1;
+	checkVariant(CPU_NMOS);
+	checkVariant(CPU_65C02);
+	for(i = 0; i < (int)(sizeof(pairs) / sizeof(pairs[0])); i++) {
+		checkPair(CPU_NMOS, &pairs[i]);
+		checkPair(CPU_65C02, &pairs[i]);
+	}
+
+	printf("TIMING: %i opcodes, %i failures\n", checked, failures);
+	return failures == 0 ? 0 : 1;
+}
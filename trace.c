@@ -0,0 +1,633 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "trace.h"
+
+#define TRACE_MAGIC "6502TRC1"
+#define TRACE_INDEX_MAGIC "TIDX"
+#define TRACE_BLOCK_SIZE 65536 // encoded bytes per block
+#define TRACE_QUEUE_BLOCKS 4 // blocks the emulation thread can get ahead of the writer thread
+#define TRACE_MAX_RECORD (1 + 3 + 10 + 5 + 1 + TRACE_MAX_WRITES * 3)
+#define TRACE_BLOCK_HEADER 27 // raw length, stored length, records (4 bytes each), keyframe (15)
+#define TRACE_STORED 0x80000000u // stored length flag: the block is not compressed
+
+// record header bits: which registers follow, and whether writes do
+#define TRACE_A 0x1
+#define TRACE_X 0x2
+#define TRACE_Y 0x4
+#define TRACE_SP 0x8
+#define TRACE_PS 0x10
+#define TRACE_WRITES 0x20
+
+#define LZ_HASH_BITS 14
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 0xFFFF
+
+typedef struct {
+	long long cycles;
+	int pc;
+	unsigned char a, x, y, sp, ps;
+} TraceState;
+
+typedef struct {
+	unsigned char data[TRACE_BLOCK_SIZE];
+	int length;
+	int recordCount;
+	TraceState keyframe; // state before the first record
+} TraceBlock;
+
+typedef struct {
+	long long cycles; // keyframe cycles
+	unsigned long long offset;
+} TraceIndexEntry;
+
+struct TraceWriter {
+	CPU *cpu;
+	FILE *file;
+	WriteLog writeLog;
+	TraceState previous;
+	TraceBlock *current;
+	
+	// filled blocks go from the emulation thread to the writer thread through this ring
+	TraceBlock blocks[TRACE_QUEUE_BLOCKS];
+	int head; // next block the writer thread takes
+	int tail; // next block the emulation thread fills
+	int stopping;
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+	pthread_t thread;
+	
+	// writer thread only
+	unsigned char compressed[LZ_BOUND(TRACE_BLOCK_SIZE)];
+	TraceIndexEntry *index;
+	int indexCount;
+	unsigned long long offset;
+	int failed;
+};
+
+struct TraceReader {
+	FILE *file;
+	TraceIndexEntry *index;
+	int blockCount;
+	int block; // loaded block, -1 for none
+	unsigned char data[TRACE_BLOCK_SIZE];
+	int length;
+	int position;
+	TraceState state;
+	unsigned char stored[LZ_BOUND(TRACE_BLOCK_SIZE)];
+	TraceRecord pending; // found by seekTrace, returned by the next readTraceRecord
+	int hasPending;
+};
+
+// LZ codec: sequences of a token (literal count << 4 | match length - 4, 15 in either half means more
+// length bytes follow, each adding up to 255), the literals and a 2 byte match offset. The last sequence
+// has literals only.
+
+static unsigned int lzHash(const unsigned char *bytes) {
+	unsigned int value;
+	memcpy(&value, bytes, sizeof(value));
+	return (value * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static unsigned char *lzWriteLength(unsigned char *out, int length) {
+	while(length >= 255) {
+		*out++ = 255;
+		length -= 255;
+	}
+	*out++ = length;
+	return out;
+}
+
+static unsigned char *lzWriteSequence(unsigned char *out, const unsigned char *literals, int literal_count, int offset, int match_length) {
+	unsigned char *token = out++;
+	int match_code = (match_length > 0 ? match_length - LZ_MIN_MATCH : 0);
+	
+	*token = ((literal_count < 15 ? literal_count : 15) << 4) | (match_code < 15 ? match_code : 15);
+	if(literal_count >= 15) {
+		out = lzWriteLength(out, literal_count - 15);
+	}
+	memcpy(out, literals, literal_count);
+	out += literal_count;
+	if(match_length > 0) {
+		*out++ = offset & 0xFF;
+		*out++ = offset >> 0x8;
+		if(match_code >= 15) {
+			out = lzWriteLength(out, match_code - 15);
+		}
+	}
+	return out;
+}
+
+int lzCompress(const unsigned char *in, int length, unsigned char *out) {
+	int table[1 << LZ_HASH_BITS];
+	unsigned char *output = out;
+	int anchor = 0;
+	int i = 0;
+	
+	memset(table, 0xFF, sizeof(table)); // -1: nothing seen
+	while(i + LZ_MIN_MATCH <= length) {
+		unsigned int hash = lzHash(in + i);
+		int candidate = table[hash];
+		table[hash] = i;
+		if(candidate < 0 || i - candidate > LZ_MAX_OFFSET || memcmp(in + candidate, in + i, LZ_MIN_MATCH) != 0) {
+			i++;
+			continue;
+		}
+	
+		int match_length = LZ_MIN_MATCH;
+		while(i + match_length < length && in[candidate + match_length] == in[i + match_length]) {
+			match_length++;
+		}
+		output = lzWriteSequence(output, in + anchor, i - anchor, i - candidate, match_length);
+		i += match_length;
+		anchor = i;
+	}
+	output = lzWriteSequence(output, in + anchor, length - anchor, 0, 0);
+	
+	return output - out;
+}
+
+static int lzReadLength(const unsigned char **in, const unsigned char *end, int *length) {
+	int byte;
+	
+	do {
+		if(*in >= end) {
+			return -1;
+		}
+		byte = *(*in)++;
+		*length += byte;
+	} while(byte == 255);
+	return 0;
+}
+
+int lzDecompress(const unsigned char *in, int length, unsigned char *out, int capacity) {
+	const unsigned char *end = in + length;
+	int position = 0;
+	
+	while(in < end) {
+		int token = *in++;
+		int literal_count = token >> 4;
+		if(literal_count == 15 && lzReadLength(&in, end, &literal_count) < 0) {
+			return -1;
+		}
+		if(literal_count > end - in || literal_count > capacity - position) {
+			return -1;
+		}
+		memcpy(out + position, in, literal_count);
+		in += literal_count;
+		position += literal_count;
+		if(in == end) {
+			break; // the last sequence has no match
+		}
+	
+		if(end - in < 2) {
+			return -1;
+		}
+		int offset = in[0] | (in[1] << 0x8);
+		int match_length = (token & 0xF) + LZ_MIN_MATCH;
+		in += 2;
+		if((token & 0xF) == 15 && lzReadLength(&in, end, &match_length) < 0) {
+			return -1;
+		}
+		if(offset == 0 || offset > position || match_length > capacity - position) {
+			return -1;
+		}
+		for(int i = 0; i < match_length; i++, position++) { // byte by byte, a match can overlap its own output
+			out[position] = out[position - offset];
+		}
+	}
+	
+	return position;
+}
+
+static unsigned char *putNumber(unsigned char *out, unsigned long long value, int size) {
+	int i;
+	for(i = 0; i < size; i++) {
+		*out++ = (value >> (i * 8)) & 0xFF;
+	}
+	return out;
+}
+
+static unsigned long long getNumber(const unsigned char *in, int size) {
+	unsigned long long value = 0;
+	int i;
+	for(i = 0; i < size; i++) {
+		value |= (unsigned long long)in[i] << (i * 8);
+	}
+	return value;
+}
+
+// signed values as LEB128 of their zigzag encoding (small either way round, small bytes)
+static unsigned char *putVarint(unsigned char *out, long long value) {
+	unsigned long long zigzag = ((unsigned long long)value << 1) ^ (unsigned long long)(value >> 63);
+	while(zigzag >= 0x80) {
+		*out++ = (zigzag & 0x7F) | 0x80;
+		zigzag >>= 7;
+	}
+	*out++ = zigzag;
+	return out;
+}
+
+static int getVarint(const unsigned char **in, const unsigned char *end, long long *value) {
+	unsigned long long zigzag = 0;
+	int shift = 0;
+	int byte;
+	
+	do {
+		if(*in >= end || shift > 63) {
+			return -1;
+		}
+		byte = *(*in)++;
+		zigzag |= (unsigned long long)(byte & 0x7F) << shift;
+		shift += 7;
+	} while(byte & 0x80);
+	*value = (long long)(zigzag >> 1) ^ -(long long)(zigzag & 0x1);
+	return 0;
+}
+
+static void putKeyframe(unsigned char *out, const TraceState *state) {
+	out = putNumber(out, state->cycles, 8);
+	out = putNumber(out, state->pc, 2);
+	*out++ = state->a;
+	*out++ = state->x;
+	*out++ = state->y;
+	*out++ = state->sp;
+	*out = state->ps;
+}
+
+static void getKeyframe(const unsigned char *in, TraceState *state) {
+	state->cycles = getNumber(in, 8);
+	state->pc = getNumber(in + 8, 2);
+	state->a = in[10];
+	state->x = in[11];
+	state->y = in[12];
+	state->sp = in[13];
+	state->ps = in[14];
+}
+
+// writer thread: compresses and writes one block, adds it to the index
+static void writeBlock(TraceWriter *writer, TraceBlock *block) {
+	unsigned char header[TRACE_BLOCK_HEADER];
+	int length = lzCompress(block->data, block->length, writer->compressed);
+	const unsigned char *stored = writer->compressed;
+	unsigned int stored_length = length;
+	
+	if(length >= block->length) {
+		stored = block->data;
+		stored_length = block->length | TRACE_STORED;
+		length = block->length;
+	}
+	
+	TraceIndexEntry *index = realloc(writer->index, sizeof(TraceIndexEntry) * (writer->indexCount + 1));
+	if(index == NULL) {
+		writer->failed = 1;
+		return;
+	}
+	writer->index = index;
+	index[writer->indexCount].cycles = block->keyframe.cycles;
+	index[writer->indexCount++].offset = writer->offset;
+	
+	putNumber(header, block->length, 4);
+	putNumber(header + 4, stored_length, 4);
+	putNumber(header + 8, block->recordCount, 4);
+	putKeyframe(header + 12, &block->keyframe);
+	if(fwrite(header, 1, sizeof(header), writer->file) != sizeof(header) || fwrite(stored, 1, length, writer->file) != (size_t)length) {
+		writer->failed = 1;
+	}
+	writer->offset += sizeof(header) + length;
+}
+
+static void *runTraceWriter(void *context) {
+	TraceWriter *writer = context;
+	
+	pthread_mutex_lock(&writer->lock);
+	for(;;) {
+		while(writer->head == writer->tail && !writer->stopping) {
+			pthread_cond_wait(&writer->changed, &writer->lock);
+		}
+		if(writer->head == writer->tail) {
+			break; // stopping and nothing left
+		}
+		TraceBlock *block = &writer->blocks[writer->head % TRACE_QUEUE_BLOCKS];
+		pthread_mutex_unlock(&writer->lock);
+		writeBlock(writer, block);
+		pthread_mutex_lock(&writer->lock);
+		writer->head++;
+		pthread_cond_broadcast(&writer->changed);
+	}
+	pthread_mutex_unlock(&writer->lock);
+	
+	return NULL;
+}
+
+static void startBlock(TraceWriter *writer) {
+	writer->current = &writer->blocks[writer->tail % TRACE_QUEUE_BLOCKS];
+	writer->current->length = 0;
+	writer->current->recordCount = 0;
+	writer->current->keyframe = writer->previous;
+}
+
+// hands the current block to the writer thread, waiting if it is TRACE_QUEUE_BLOCKS behind
+static void queueBlock(TraceWriter *writer) {
+	pthread_mutex_lock(&writer->lock);
+	writer->tail++;
+	pthread_cond_broadcast(&writer->changed);
+	while(writer->tail - writer->head >= TRACE_QUEUE_BLOCKS) {
+		pthread_cond_wait(&writer->changed, &writer->lock);
+	}
+	pthread_mutex_unlock(&writer->lock);
+}
+
+static void takeState(TraceState *state, CPU *cpu) {
+	state->cycles = cpu->cycles;
+	state->pc = cpu->pc;
+	state->a = cpu->a;
+	state->x = cpu->x;
+	state->y = cpu->y;
+	state->sp = cpu->sp;
+	state->ps = cpu->ps;
+}
+
+TraceWriter *openTraceWriter(CPU *cpu, FILE *file) {
+	TraceWriter *writer = calloc(1, sizeof(TraceWriter));
+	
+	if(writer == NULL) {
+		return NULL;
+	}
+	writer->cpu = cpu;
+	writer->file = file;
+	writer->offset = strlen(TRACE_MAGIC);
+	takeState(&writer->previous, cpu);
+	startBlock(writer);
+	pthread_mutex_init(&writer->lock, NULL);
+	pthread_cond_init(&writer->changed, NULL);
+	
+	if(fwrite(TRACE_MAGIC, 1, strlen(TRACE_MAGIC), file) != strlen(TRACE_MAGIC) || pthread_create(&writer->thread, NULL, runTraceWriter, writer) != 0) {
+		pthread_mutex_destroy(&writer->lock);
+		pthread_cond_destroy(&writer->changed);
+		free(writer);
+		return NULL;
+	}
+	cpu->writeLog = &writer->writeLog;
+	writer->writeLog.count = 0;
+	return writer;
+}
+
+void traceInstruction(TraceWriter *writer, CPU *cpu) {
+	TraceState *previous = &writer->previous;
+	WriteLog *log = &writer->writeLog;
+	int i;
+	
+	if(writer->current->length > TRACE_BLOCK_SIZE - TRACE_MAX_RECORD) {
+		queueBlock(writer);
+		startBlock(writer);
+	}
+	
+	unsigned char *start = writer->current->data + writer->current->length;
+	unsigned char *out = start + 1;
+	int header = (log->count > 0 ? TRACE_WRITES : 0);
+	
+	out = putVarint(out, (short)(cpu->pc - previous->pc)); // pc wraps at 16 bits, so does the delta
+	out = putVarint(out, cpu->cycles - previous->cycles);
+	if(cpu->a != previous->a) {
+		header |= TRACE_A;
+		*out++ = cpu->a;
+	}
+	if(cpu->x != previous->x) {
+		header |= TRACE_X;
+		*out++ = cpu->x;
+	}
+	if(cpu->y != previous->y) {
+		header |= TRACE_Y;
+		*out++ = cpu->y;
+	}
+	if(cpu->sp != previous->sp) {
+		header |= TRACE_SP;
+		*out++ = cpu->sp;
+	}
+	if(cpu->ps != previous->ps) {
+		header |= TRACE_PS;
+		*out++ = cpu->ps;
+	}
+	if(log->count > 0) {
+		*out++ = log->count;
+		for(i = 0; i < log->count; i++) {
+			out = putNumber(out, log->addresses[i], 2);
+			*out++ = log->values[i];
+		}
+		log->count = 0;
+	}
+	*start = header;
+	
+	writer->current->length = out - writer->current->data;
+	writer->current->recordCount++;
+	takeState(previous, cpu);
+}
+
+int closeTraceWriter(TraceWriter *writer) {
+	unsigned char footer[16];
+	int i, failed;
+	
+	writer->cpu->writeLog = NULL;
+	pthread_mutex_lock(&writer->lock);
+	if(writer->current->recordCount > 0) {
+		writer->tail++;
+	}
+	writer->stopping = 1;
+	pthread_cond_broadcast(&writer->changed);
+	pthread_mutex_unlock(&writer->lock);
+	pthread_join(writer->thread, NULL);
+	
+	for(i = 0; i < writer->indexCount; i++) {
+		unsigned char entry[16];
+		putNumber(entry, writer->index[i].cycles, 8);
+		putNumber(entry + 8, writer->index[i].offset, 8);
+		if(fwrite(entry, 1, sizeof(entry), writer->file) != sizeof(entry)) {
+			writer->failed = 1;
+		}
+	}
+	putNumber(footer, writer->offset, 8);
+	putNumber(footer + 8, writer->indexCount, 4);
+	memcpy(footer + 12, TRACE_INDEX_MAGIC, 4);
+	if(fwrite(footer, 1, sizeof(footer), writer->file) != sizeof(footer) || fflush(writer->file) != 0) {
+		writer->failed = 1;
+	}
+	
+	failed = writer->failed;
+	pthread_mutex_destroy(&writer->lock);
+	pthread_cond_destroy(&writer->changed);
+	free(writer->index);
+	free(writer);
+	return failed ? -1 : 0;
+}
+
+TraceReader *openTraceReader(FILE *file) {
+	unsigned char footer[16];
+	unsigned char magic[8];
+	TraceReader *reader;
+	int i;
+	
+	if(fseek(file, 0, SEEK_SET) != 0 || fread(magic, 1, sizeof(magic), file) != sizeof(magic) || memcmp(magic, TRACE_MAGIC, sizeof(magic)) != 0 ||
+		fseek(file, -(long)sizeof(footer), SEEK_END) != 0 || fread(footer, 1, sizeof(footer), file) != sizeof(footer) ||
+		memcmp(footer + 12, TRACE_INDEX_MAGIC, 4) != 0) {
+		return NULL;
+	}
+	if((reader = calloc(1, sizeof(TraceReader))) == NULL) {
+		return NULL;
+	}
+	reader->file = file;
+	reader->blockCount = getNumber(footer + 8, 4);
+	reader->index = malloc(sizeof(TraceIndexEntry) * (reader->blockCount + 1));
+	reader->block = -1;
+	if(reader->index == NULL || fseek(file, getNumber(footer, 8), SEEK_SET) != 0) {
+		closeTraceReader(reader);
+		return NULL;
+	}
+	for(i = 0; i < reader->blockCount; i++) {
+		unsigned char entry[16];
+		if(fread(entry, 1, sizeof(entry), file) != sizeof(entry)) {
+			closeTraceReader(reader);
+			return NULL;
+		}
+		reader->index[i].cycles = getNumber(entry, 8);
+		reader->index[i].offset = getNumber(entry + 8, 8);
+	}
+	return reader;
+}
+
+void closeTraceReader(TraceReader *reader) {
+	if(reader == NULL) {
+		return;
+	}
+	free(reader->index);
+	free(reader);
+}
+
+static int loadBlock(TraceReader *reader, int block) {
+	unsigned char header[TRACE_BLOCK_HEADER];
+	
+	if(fseek(reader->file, reader->index[block].offset, SEEK_SET) != 0 || fread(header, 1, sizeof(header), reader->file) != sizeof(header)) {
+		return -1;
+	}
+	int length = getNumber(header, 4);
+	unsigned int stored_length = getNumber(header + 4, 4);
+	int compressed = !(stored_length & TRACE_STORED);
+	stored_length &= ~TRACE_STORED;
+	if(length > TRACE_BLOCK_SIZE || stored_length > sizeof(reader->stored)) {
+		return -1;
+	}
+	
+	if(fread(compressed ? reader->stored : reader->data, 1, stored_length, reader->file) != stored_length ||
+		(compressed && lzDecompress(reader->stored, stored_length, reader->data, TRACE_BLOCK_SIZE) != length) || (!compressed && stored_length != (unsigned int)length)) {
+		return -1;
+	}
+	getKeyframe(header + 12, &reader->state);
+	reader->block = block;
+	reader->length = length;
+	reader->position = 0;
+	return 0;
+}
+
+static int decodeRecord(TraceReader *reader, TraceRecord *record) {
+	const unsigned char *in = reader->data + reader->position;
+	const unsigned char *end = reader->data + reader->length;
+	TraceState *state = &reader->state;
+	long long pc_delta, cycles_delta;
+	int i;
+	
+	int header = *in++;
+	if(getVarint(&in, end, &pc_delta) < 0 || getVarint(&in, end, &cycles_delta) < 0) {
+		return -1;
+	}
+	int register_count = !!(header & TRACE_A) + !!(header & TRACE_X) + !!(header & TRACE_Y) + !!(header & TRACE_SP) + !!(header & TRACE_PS);
+	if(end - in < register_count + !!(header & TRACE_WRITES)) {
+		return -1;
+	}
+	state->pc = (state->pc + pc_delta) & 0xFFFF;
+	state->cycles += cycles_delta;
+	if(header & TRACE_A) {
+		state->a = *in++;
+	}
+	if(header & TRACE_X) {
+		state->x = *in++;
+	}
+	if(header & TRACE_Y) {
+		state->y = *in++;
+	}
+	if(header & TRACE_SP) {
+		state->sp = *in++;
+	}
+	if(header & TRACE_PS) {
+		state->ps = *in++;
+	}
+	
+	record->writeCount = 0;
+	if(header & TRACE_WRITES) {
+		record->writeCount = *in++;
+		if(record->writeCount > TRACE_MAX_WRITES || end - in < record->writeCount * 3) {
+			return -1;
+		}
+		for(i = 0; i < record->writeCount; i++, in += 3) {
+			record->writeAddresses[i] = getNumber(in, 2);
+			record->writeValues[i] = in[2];
+		}
+	}
+	
+	record->cycles = state->cycles;
+	record->pc = state->pc;
+	record->a = state->a;
+	record->x = state->x;
+	record->y = state->y;
+	record->sp = state->sp;
+	record->ps = state->ps;
+	reader->position = in - reader->data;
+	return 1;
+}
+
+int readTraceRecord(TraceReader *reader, TraceRecord *record) {
+	if(reader->hasPending) {
+		*record = reader->pending;
+		reader->hasPending = 0;
+		return 1;
+	}
+	while(reader->block < 0 || reader->position >= reader->length) {
+		if(reader->block + 1 >= reader->blockCount) {
+			return 0;
+		}
+		if(loadBlock(reader, reader->block + 1) < 0) {
+			return -1;
+		}
+	}
+	return decodeRecord(reader, record);
+}
+
+int seekTrace(TraceReader *reader, long long cycles) {
+	int low = 0, high = reader->blockCount - 1, block = 0;
+	int result;
+	
+	// last block starting before cycles: a keyframe is the state after the previous block's last record, so a block
+	// starting exactly at cycles holds the record at cycles only as its predecessor's last one
+	while(low <= high) {
+		int middle = (low + high) / 2;
+		if(reader->index[middle].cycles < cycles) {
+			block = middle;
+			low = middle + 1;
+		} else {
+			high = middle - 1;
+		}
+	}
+	reader->hasPending = 0;
+	if(reader->blockCount == 0) {
+		return 0;
+	}
+	if(loadBlock(reader, block) < 0) {
+		return -1;
+	}
+	while((result = readTraceRecord(reader, &reader->pending)) == 1) {
+		if(reader->pending.cycles >= cycles) {
+			reader->hasPending = 1;
+			break;
+		}
+	}
+	return result;
+}
@@ -0,0 +1,60 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include "cpu.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Compact instruction trace for long runs. Every instruction becomes one record of the state after it:
+// pc and cycles as deltas from the previous record, only the registers that changed, and the guest writes
+// it made (address and value), so a typical record is 3 or 4 bytes before compression.
+// Records are packed into 64 KiB blocks, each starting from a keyframe (the full register state), and a
+// background thread compresses them with a small built-in LZ codec and writes them out, so the emulation
+// thread only encodes. An index of the blocks' first cycle counts at the end of the file makes it seekable.
+//
+// File: "6502TRC1", blocks (header, then the LZ or stored bytes), the index, and a 16 byte footer
+// (index offset, block count, "TIDX"). All numbers little endian.
+
+#define TRACE_MAX_WRITES WRITE_LOG_SIZE
+
+typedef struct {
+	long long cycles;
+	int pc;
+	unsigned char a, x, y, sp, ps;
+	int writeCount;
+	unsigned short writeAddresses[TRACE_MAX_WRITES];
+	unsigned char writeValues[TRACE_MAX_WRITES];
+} TraceRecord;
+
+typedef struct TraceWriter TraceWriter;
+typedef struct TraceReader TraceReader;
+
+// starts logging cpu's writes (cpu->writeLog) and the writer thread; NULL if it can't
+TraceWriter *openTraceWriter(CPU *cpu, FILE *file);
+// after every instruction cpu runs while the writer is open
+void traceInstruction(TraceWriter *writer, CPU *cpu);
+// writes the last block and the index, stops the thread; the file stays open. Returns -1 if any write failed.
+int closeTraceWriter(TraceWriter *writer);
+
+// NULL if file is not a complete trace
+TraceReader *openTraceReader(FILE *file);
+void closeTraceReader(TraceReader *reader);
+// the next record: 1, 0 at the end of the trace, -1 if the file is damaged
+int readTraceRecord(TraceReader *reader, TraceRecord *record);
+// the next record read is the first one at or past cycles (decodes one block at most to get there)
+int seekTrace(TraceReader *reader, long long cycles);
+
+// LZ codec used for the blocks: compress returns the output length (out needs LZ_BOUND(length) bytes),
+// decompress returns the output length or -1 if in is damaged or doesn't fit in capacity
+#define LZ_BOUND(length) ((length) + (length) / 255 + 16)
+int lzCompress(const unsigned char *in, int length, unsigned char *out);
+int lzDecompress(const unsigned char *in, int length, unsigned char *out, int capacity);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cpu.h"
+#include "trace.h"
+
+// Check of the trace format: the LZ codec has to give back random, repetitive and mixed buffers byte for byte (and
+// refuse output that doesn't fit), and a trace of a long run has to read back as the states the CPU went through,
+// record after record across blocks, with seekTrace at any record's cycles landing on exactly that record.
+
+#define CHECK_INSTRUCTIONS 30000 // a few blocks of records
+#define CHECK_ORIGIN 0x0400
+#define CHECK_BUFFER 200000
+
+// loop with a bit of everything a record holds, mostly instructions that write so the records are long and the
+// trace spans a few blocks: register changes, stack and memory writes, jumps
+static const unsigned char program[] = {
+	0xE8,             // INX
+	0x8A,             // TXA
+	0x48,             // PHA
+	0x20, 0x10, 0x04, // JSR $0410
+	0x68,             // PLA
+	0x9D, 0x00, 0x30, // STA $3000,X
+	0xC8,             // INY
+	0x4C, 0x00, 0x04, // JMP $0400
+	0xEA, 0xEA,       // (unused)
+	0xEE, 0x21, 0x00, // $0410: INC $0021
+	0x99, 0x00, 0x31, // STA $3100,Y
+	0x60,             // RTS
+};
+
+static int failures = 0;
+static unsigned int seed = 1;
+
+static unsigned char randomByte(void) {
+	seed = seed * 1103515245u + 12345u;
+	return seed >> 16;
+}
+
+static void checkCodec(const char *name, const unsigned char *in, int length) {
+	static unsigned char compressed[LZ_BOUND(CHECK_BUFFER)];
+	static unsigned char out[CHECK_BUFFER];
+
+	int compressed_length = lzCompress(in, length, compressed);
+	if(compressed_length > LZ_BOUND(length)) {
+		printf("%s, %i bytes: compressed to %i bytes, more than LZ_BOUND\n", name, length, compressed_length);
+		failures++;
+	}
+	int out_length = lzDecompress(compressed, compressed_length, out, length);
+	if(out_length != length || memcmp(in, out, length) != 0) {
+		printf("%s, %i bytes: decompressed to %i bytes that differ\n", name, length, out_length);
+		failures++;
+	}
+	if(length > 0 && lzDecompress(compressed, compressed_length, out, length - 1) != -1) {
+		printf("%s, %i bytes: decompressed into %i bytes\n", name, length, length - 1);
+		failures++;
+	}
+}
+
+static void checkCodecs(void) {
+	static const int lengths[] = { 0, 1, 3, 4, 5, 15, 16, 19, 270, 4096, 65536, CHECK_BUFFER };
+	static unsigned char buffer[CHECK_BUFFER];
+	int i, j;
+
+	for(i = 0; i < (int)(sizeof(lengths) / sizeof(lengths[0])); i++) {
+		int length = lengths[i];
+
+		for(j = 0; j < length; j++) {
+			buffer[j] = randomByte();
+		}
+		checkCodec("random", buffer, length);
+		for(j = 0; j < length; j++) {
+			buffer[j] = 0x55;
+		}
+		checkCodec("one byte", buffer, length);
+		for(j = 0; j < length; j++) {
+			buffer[j] = "6502 trace "[j % 11];
+		}
+		checkCodec("repeated text", buffer, length);
+		for(j = 0; j < length; j++) { // runs of repeats between random stretches, matches far and near
+			buffer[j] = ((j / 300) % 3 == 0 ? randomByte() : (j >= 70000 ? buffer[j - 70000 + (j % 7)] : buffer[j / 2]));
+		}
+		checkCodec("mixed", buffer, length);
+	}
+}
+
+static int sameRecord(const TraceRecord *first, const TraceRecord *second) {
+	return first->cycles == second->cycles && first->pc == second->pc && first->a == second->a && first->x == second->x &&
+		first->y == second->y && first->sp == second->sp && first->ps == second->ps && first->writeCount == second->writeCount &&
+		memcmp(first->writeAddresses, second->writeAddresses, first->writeCount * sizeof(first->writeAddresses[0])) == 0 &&
+		memcmp(first->writeValues, second->writeValues, first->writeCount) == 0;
+}
+
+static void checkTrace(void) {
+	static TraceRecord records[CHECK_INSTRUCTIONS];
+	TraceRecord record = { 0 };
+	CPU cpu;
+	int count = 0;
+	int i, result;
+
+	FILE *file = tmpfile();
+	if(file == NULL) {
+		printf("Can't open a temporary file.\n");
+		failures++;
+		return;
+	}
+	initializeCPU(&cpu);
+	writeMemory(&cpu, (char *)program, CHECK_ORIGIN, sizeof(program));
+	cpu.pc = CHECK_ORIGIN;
+	TraceWriter *writer = openTraceWriter(&cpu, file);
+	if(writer == NULL) {
+		printf("Can't open the trace writer.\n");
+		failures++;
+		fclose(file);
+		freeCPU(&cpu);
+		return;
+	}
+	for(i = 0; i < CHECK_INSTRUCTIONS; i++) {
+		TraceRecord *expected = &records[i];
+
+		step(&cpu); // the writer empties the write log after every instruction
+		expected->cycles = cpu.cycles;
+		expected->pc = cpu.pc;
+		expected->a = cpu.a;
+		expected->x = cpu.x;
+		expected->y = cpu.y;
+		expected->sp = cpu.sp;
+		expected->ps = cpu.ps;
+		expected->writeCount = cpu.writeLog->count;
+		memcpy(expected->writeAddresses, cpu.writeLog->addresses, expected->writeCount * sizeof(expected->writeAddresses[0]));
+		memcpy(expected->writeValues, cpu.writeLog->values, expected->writeCount);
+		traceInstruction(writer, &cpu);
+	}
+	if(closeTraceWriter(writer) < 0) {
+		printf("Can't write the trace.\n");
+		failures++;
+	}
+	freeCPU(&cpu);
+
+	TraceReader *reader = openTraceReader(file);
+	if(reader == NULL) {
+		printf("The trace written is not complete.\n");
+		failures++;
+		fclose(file);
+		return;
+	}
+	while((result = readTraceRecord(reader, &record)) == 1 && count < CHECK_INSTRUCTIONS) {
+		if(!sameRecord(&record, &records[count])) {
+			printf("record %i: read at %lld cycles, written at %lld\n", count, record.cycles, records[count].cycles);
+			failures++;
+		}
+		count++;
+	}
+	if(result != 0 || count != CHECK_INSTRUCTIONS) {
+		printf("read %i records (%s), wrote %i\n", count, (result < 0 ? "damaged" : "not at the end"), CHECK_INSTRUCTIONS);
+		failures++;
+	}
+
+	for(i = 0; i < CHECK_INSTRUCTIONS; i++) {
+		if(seekTrace(reader, records[i].cycles) < 0 || readTraceRecord(reader, &record) != 1 || !sameRecord(&record, &records[i])) {
+			printf("seek to %lld cycles: read the record at %lld\n", records[i].cycles, record.cycles);
+			failures++;
+		}
+	}
+	if(seekTrace(reader, records[CHECK_INSTRUCTIONS - 1].cycles + 1) < 0 || readTraceRecord(reader, &record) != 0) {
+		printf("seek past the end: read a record\n");
+		failures++;
+	}
+
+	closeTraceReader(reader);
+	fclose(file);
+}
+
+int main(int argc, char *argv[]) {
+	checkCodecs();
+	checkTrace();
+
+	printf("TRACECHECK: %i failures\n", failures);
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,52 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "trace.h"
+
+// Prints the records of a trace written with emulatorStartTrace: ./6502_tracedump trace [from cycles [count]]
+// One line per instruction: cycles and registers after it, then the writes it made as address=value.
+
+int main(int argc, char *argv[]) {
+	TraceRecord record;
+	long long count = -1;
+	int result = 0;
+	int i;
+
+	if(argc < 2 || argc > 4) {
+		printf("Usage: %s trace [from cycles [count]]\n", argv[0]);
+		return -1;
+	}
+
+	FILE *file = fopen(argv[1], "rb");
+	if(file == NULL) {
+		printf("Can't open %s.\n", argv[1]);
+		return -1;
+	}
+	TraceReader *reader = openTraceReader(file);
+	if(reader == NULL) {
+		printf("%s is not a complete trace.\n", argv[1]);
+		fclose(file);
+		return -1;
+	}
+	if(argc > 2) {
+		result = seekTrace(reader, atoll(argv[2]));
+	}
+	if(argc > 3) {
+		count = atoll(argv[3]);
+	}
+
+	while(result >= 0 && count != 0 && (result = readTraceRecord(reader, &record)) == 1) {
+		printf("%12lli pc:%04x a:%02x x:%02x y:%02x sp:%02x ps:%02x", record.cycles, record.pc, record.a, record.x, record.y, record.sp, record.ps);
+		for(i = 0; i < record.writeCount; i++) {
+			printf(" %04x=%02x", record.writeAddresses[i], record.writeValues[i]);
+		}
+		printf("\n");
+		count--;
+	}
+	if(result < 0) {
+		printf("%s is damaged.\n", argv[1]);
+	}
+
+	closeTraceReader(reader);
+	fclose(file);
+	return result < 0 ? -1 : 0;
+}